@@ -0,0 +1,75 @@
+#ifndef ATLAS_HH
+#define ATLAS_HH
+
+#include <cstddef>
+#include <cstdint>
+
+#include <stdexcept>
+#include <vector>
+
+#include <SDL.h>
+
+#include "screen.hh"
+#include "texture.hh"
+
+
+// Atlas
+// -----
+//
+// One static texture holding the art of all buttons, each in a cell of the
+// screen's tile size. Cells are handed out column by column, so the buttons
+// of a column of the screen, created top to bottom, lie below each other in
+// the atlas as well; the screen then draws the whole column as one region.
+
+class Atlas
+  : public Texture
+{
+  int rows_;
+  int count_ = 0;
+
+public:
+  Atlas ( const Screen &screen, int columns, int rows )
+    : Texture( screen, columns*screen.tileSize(), rows*screen.tileSize(), Texture::Access::Static ),
+      rows_( rows )
+  {
+    SDL_SetTextureBlendMode( texture_, SDL_BLENDMODE_BLEND );
+  }
+
+  // edge length of a cell in pixels
+  int cellSize () const { return height_ / rows_; }
+
+  // add a cell of cellSize() x cellSize() RGBA pixels, returning the
+  // position of its top left corner
+  SDL_Point add ( const std::uint8_t *pixels )
+  {
+    if( count_ == (width_ / cellSize()) * rows_ )
+      throw std::length_error( "Atlas is full" );
+    const SDL_Point cell{ (count_ / rows_) * cellSize(), (count_ % rows_) * cellSize() };
+    ++count_;
+    const SDL_Rect rect{ cell.x, cell.y, cellSize(), cellSize() };
+    SDL_UpdateTexture( texture_, &rect, pixels, 4*cellSize() );
+    return cell;
+  }
+
+  // add a cell of a solid colour
+  SDL_Point add ( Uint8 r, Uint8 g, Uint8 b )
+  {
+    std::vector< std::uint8_t > pixels( 4*cellSize()*cellSize() );
+    for( std::size_t k = 0; k < pixels.size(); k += 4 )
+    {
+      pixels[ k ] = r;
+      pixels[ k+1 ] = g;
+      pixels[ k+2 ] = b;
+      pixels[ k+3 ] = 255;
+    }
+    return add( pixels.data() );
+  }
+
+  // add a cell holding a PNG image, resampled to the cell size
+  SDL_Point add ( const void *data, std::size_t size )
+  {
+    return add( decode( data, size, cellSize(), cellSize() ).data() );
+  }
+};
+
+#endif // #ifndef ATLAS_HH
@@ -0,0 +1,83 @@
+#include <cstdlib>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../canvas.hh"
+#include "../screen.hh"
+#include "../stats.hh"
+#include "scribbles.hh"
+
+
+// draws scribbles through the whole Screen/Canvas/Texture path on a headless
+// screen, presenting a frame after every few input points like the event loop
+int main ( int argc, char **argv )
+{
+  // bench-canvas [points per frame [WxH]]
+  const int pointsPerFrame = (argc > 1 ? std::max( std::atoi( argv[ 1 ] ), 1 ) : 4);
+  Screen::Headless headless;
+  if( argc > 2 )
+    std::sscanf( argv[ 2 ], "%dx%d", &headless.width, &headless.height );
+
+  Screen screen( headless );
+  Canvas canvas( screen, 1, 0, screen.columns()-2, screen.rows() );
+  const std::vector< RecordedStroke > strokes = scribbles( canvas.width(), canvas.height() );
+  std::cout << "headless " << screen.width() << "x" << screen.height() << ", " << strokes.size() << " strokes, "
+            << pointsPerFrame << " points per frame" << std::endl;
+
+  std::cout << std::setw( 12 ) << "rasterizer" << std::setw( 10 ) << "frames" << std::setw( 12 ) << "ms/frame"
+            << std::setw( 12 ) << "ms (99%)" << std::setw( 14 ) << "points/s" << std::setw( 12 ) << "copies" << std::endl;
+  for( const Canvas::Rasterizer rasterizer : { Canvas::Rasterizer::stamps, Canvas::Rasterizer::capsules } )
+  {
+    canvas.setRasterizer( rasterizer );
+    canvas.clear();
+    canvas.clear();
+    screen.draw();
+
+    Samples< 1 << 16 > frames;
+    unsigned long points = 0, copies = 0;
+    auto frame = [ & ] () {
+        const auto start = std::chrono::steady_clock::now();
+        screen.draw();
+        frames.add( std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count() );
+        copies += screen.statistics().copies;
+      };
+
+    const Pointer pointer;
+    const auto start = std::chrono::steady_clock::now();
+    for( const RecordedStroke &stroke : strokes )
+    {
+      canvas.setBrush( stroke.brush );
+      canvas.setColor( stroke.r, stroke.g, stroke.b );
+      canvas.down( pointer, stroke.points.front().x, stroke.points.front().y );
+      for( std::size_t k = 1; k < stroke.points.size(); ++k )
+      {
+        const Stroke::Point &p = stroke.points[ k ], &q = stroke.points[ k-1 ];
+        if( k + 1 < stroke.points.size() )
+          canvas.move( pointer, p.x, p.y, p.x - q.x, p.y - q.y );
+        else
+          canvas.up( pointer, p.x, p.y );
+        if( k % pointsPerFrame == 0 )
+          frame();
+      }
+      frame();
+      points += stroke.points.size();
+    }
+    const std::chrono::duration< double > elapsed = std::chrono::steady_clock::now() - start;
+
+    double total = 0.0;
+    for( std::size_t k = 0; k < frames.size(); ++k )
+      total += frames.recent( k );
+    std::cout << std::setw( 12 ) << (rasterizer == Canvas::Rasterizer::capsules ? "capsules" : "stamps")
+              << std::setw( 10 ) << frames.size()
+              << std::setw( 12 ) << std::fixed << std::setprecision( 3 ) << (total / frames.size())
+              << std::setw( 12 ) << frames.percentile( 99 )
+              << std::setw( 14 ) << std::setprecision( 0 ) << (points / elapsed.count())
+              << std::setw( 12 ) << copies << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,62 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "../composite.hh"
+
+
+// hard round pen of given diameter with an anti-aliased edge
+static std::vector< std::uint8_t > makePen ( int size )
+{
+  std::vector< std::uint8_t > coverage( size*size );
+  const float c = 0.5f*(size - 1), r = 0.5f*size;
+  for( int y = 0; y < size; ++y )
+    for( int x = 0; x < size; ++x )
+    {
+      const float d = std::hypot( x - c, y - c );
+      coverage[ y*size + x ] = std::uint8_t( 255.0f * std::min( std::max( r - d, 0.0f ), 1.0f ) );
+    }
+  return coverage;
+}
+
+
+int main ( int argc, char **argv )
+{
+  const int width = 1800, height = 1080;
+  const int stamps = (argc > 1 ? std::atoi( argv[ 1 ] ) : 200000);
+
+  std::cout << std::setw( 8 ) << "kernel" << std::setw( 8 ) << "size" << std::setw( 16 ) << "stamps/s" << std::setw( 12 ) << "checksum" << std::endl;
+  for( int size : { 8, 16, 32, 64 } )
+  {
+    const std::vector< std::uint8_t > pen = makePen( size );
+    for( const CompositeKernel &kernel : compositeKernels() )
+    {
+      std::vector< std::uint8_t > canvas( 4*width*height, 255 );
+
+      // a deterministic pseudo-stroke over the canvas
+      const auto start = std::chrono::steady_clock::now();
+      for( int k = 0; k < stamps; ++k )
+      {
+        const int x = (k * 7) % (width - size), y = (k * 13 / 7) % (height - size);
+        kernel.blend( canvas.data() + 4*(y*width + x), 4*width, pen.data(), size, size, size, std::uint8_t( k ), std::uint8_t( k >> 3 ), std::uint8_t( k >> 6 ) );
+      }
+      const std::chrono::duration< double > elapsed = std::chrono::steady_clock::now() - start;
+
+      std::uint32_t checksum = 0;
+      for( std::uint8_t c : canvas )
+        checksum = checksum * 31 + c;
+
+      std::cout << std::setw( 8 ) << kernel.name << std::setw( 8 ) << size
+                << std::setw( 16 ) << std::fixed << std::setprecision( 0 ) << (stamps / elapsed.count())
+                << std::setw( 12 ) << std::hex << checksum << std::dec << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,193 @@
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/uinput.h>
+
+#include "../evdev.hh"
+#include "../stats.hh"
+
+
+// a virtual multi-touch screen, created through uinput
+class VirtualTouchScreen
+{
+  int fd_;
+
+  void send ( int type, int code, int value )
+  {
+    input_event event;
+    std::memset( &event, 0, sizeof( event ) );
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    if( write( fd_, &event, sizeof( event ) ) != sizeof( event ) )
+      throw std::runtime_error( "Unable to write to uinput device" );
+  }
+
+public:
+  static constexpr int size = 4096;
+
+  VirtualTouchScreen ()
+    : fd_( open( "/dev/uinput", O_WRONLY | O_NONBLOCK ) )
+  {
+    if( fd_ < 0 )
+      throw std::runtime_error( "Unable to open /dev/uinput" );
+
+    ioctl( fd_, UI_SET_EVBIT, EV_SYN );
+    ioctl( fd_, UI_SET_EVBIT, EV_KEY );
+    ioctl( fd_, UI_SET_KEYBIT, BTN_TOUCH );
+    ioctl( fd_, UI_SET_EVBIT, EV_ABS );
+    ioctl( fd_, UI_SET_PROPBIT, INPUT_PROP_DIRECT );
+    for( int axis : { ABS_MT_SLOT, ABS_MT_TRACKING_ID, ABS_MT_POSITION_X, ABS_MT_POSITION_Y } )
+    {
+      ioctl( fd_, UI_SET_ABSBIT, axis );
+      uinput_abs_setup setup;
+      std::memset( &setup, 0, sizeof( setup ) );
+      setup.code = axis;
+      setup.absinfo.maximum = (axis == ABS_MT_SLOT ? TouchReader::maxSlots-1 : (axis == ABS_MT_TRACKING_ID ? 65535 : size-1));
+      ioctl( fd_, UI_ABS_SETUP, &setup );
+    }
+
+    uinput_setup setup;
+    std::memset( &setup, 0, sizeof( setup ) );
+    setup.id.bustype = BUS_VIRTUAL;
+    std::strcpy( setup.name, "kidz-draw virtual touch screen" );
+    if( (ioctl( fd_, UI_DEV_SETUP, &setup ) != 0) || (ioctl( fd_, UI_DEV_CREATE ) != 0) )
+    {
+      close( fd_ );
+      throw std::runtime_error( "Unable to create uinput device" );
+    }
+  }
+
+  ~VirtualTouchScreen ()
+  {
+    ioctl( fd_, UI_DEV_DESTROY );
+    close( fd_ );
+  }
+
+  // the event device (/dev/input/eventN) of the virtual touch screen
+  std::string device () const
+  {
+    char name[ 64 ];
+    if( ioctl( fd_, UI_GET_SYSNAME( sizeof( name ) ), name ) < 0 )
+      throw std::runtime_error( "Unable to obtain name of uinput device" );
+    const std::string path = std::string( "/sys/devices/virtual/input/" ) + name;
+    DIR *dir = opendir( path.c_str() );
+    if( !dir )
+      throw std::runtime_error( "Unable to open '" + path + "'" );
+    std::string device;
+    while( dirent *entry = readdir( dir ) )
+    {
+      if( std::strncmp( entry->d_name, "event", 5 ) == 0 )
+        device = std::string( "/dev/input/" ) + entry->d_name;
+    }
+    closedir( dir );
+    return device;
+  }
+
+  // one report of a finger in slot 0 (tracking id -1 lifts it)
+  void report ( int id, int x, int y )
+  {
+    send( EV_ABS, ABS_MT_SLOT, 0 );
+    send( EV_ABS, ABS_MT_TRACKING_ID, id );
+    if( id >= 0 )
+    {
+      send( EV_ABS, ABS_MT_POSITION_X, x );
+      send( EV_ABS, ABS_MT_POSITION_Y, y );
+    }
+    send( EV_KEY, BTN_TOUCH, (id >= 0 ? 1 : 0) );
+    send( EV_SYN, SYN_REPORT, 0 );
+  }
+};
+
+
+static std::uint64_t now ()
+{
+  timespec time;
+  clock_gettime( CLOCK_MONOTONIC, &time );
+  return std::uint64_t( time.tv_sec ) * 1000000u + std::uint64_t( time.tv_nsec ) / 1000u;
+}
+
+
+int main ( int argc, char **argv )
+{
+  // bench-evdev [reports [rate]]
+  const int reports = (argc > 1 ? std::atoi( argv[ 1 ] ) : 10000);
+  const int rate = (argc > 2 ? std::atoi( argv[ 2 ] ) : 1000);
+
+  try
+  {
+    VirtualTouchScreen screen;
+    // give udev some time to create the device node
+    std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
+    const std::string device = screen.device();
+    TouchReader reader( device );
+
+    std::mutex mutex;
+    std::condition_variable available;
+    bool notified = false;
+    reader.start( [ & ] () {
+        std::lock_guard< std::mutex > lock( mutex );
+        notified = true;
+        available.notify_one();
+      } );
+
+    // stroke diagonally across the screen at the given report rate
+    std::thread writer( [ & ] () {
+        const auto interval = std::chrono::microseconds( 1000000 / std::max( rate, 1 ) );
+        auto next = std::chrono::steady_clock::now();
+        for( int k = 0; k <= reports; ++k, next += interval )
+        {
+          std::this_thread::sleep_until( next );
+          const int p = int( std::int64_t( k ) * (VirtualTouchScreen::size-1) / std::max( reports, 1 ) );
+          screen.report( (k < reports ? 1 : -1), p, p );
+        }
+      } );
+
+    Samples< 1 << 16 > latency;
+    int samples = 0, notifications = 0;
+    bool lifted = false;
+    while( !lifted )
+    {
+      std::unique_lock< std::mutex > lock( mutex );
+      if( !available.wait_for( lock, std::chrono::seconds( 2 ), [ &notified ] () { return notified; } ) )
+        break;
+      notified = false;
+      lock.unlock();
+
+      ++notifications;
+      reader.drain( [ & ] ( const TouchSample &sample ) {
+          latency.add( double( now() - sample.time ) / 1000.0 );
+          ++samples;
+          lifted |= (sample.type == TouchSample::up);
+        } );
+    }
+    writer.join();
+
+    std::cout << device << ": " << reports << " reports at " << rate << " Hz" << std::endl;
+    std::cout << std::setw( 12 ) << "samples" << std::setw( 12 ) << "dropped" << std::setw( 16 ) << "notifications"
+              << std::setw( 12 ) << "ms (50%)" << std::setw( 12 ) << "ms (99%)" << std::endl;
+    std::cout << std::setw( 12 ) << samples << std::setw( 12 ) << reader.dropped() << std::setw( 16 ) << notifications
+              << std::setw( 12 ) << std::fixed << std::setprecision( 3 ) << latency.percentile( 50 )
+              << std::setw( 12 ) << latency.percentile( 99 ) << std::endl;
+    return (samples == reports+1 ? 0 : 1);
+  }
+  catch( const std::exception &e )
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
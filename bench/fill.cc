@@ -0,0 +1,53 @@
+#include <cstdint>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#include "../fill.hh"
+#include "../image.hh"
+
+
+// a canvas covered by a grid of black lines, so fills cross many spans
+static void drawGrid ( Image &image, int spacing )
+{
+  for( int y = 0; y < image.height(); ++y )
+    for( int x = 0; x < image.width(); ++x )
+    {
+      if( (x % spacing != 0) && (y % spacing != (x / spacing) % spacing) )
+        continue;
+      std::uint8_t *p = image.pixel( x, y );
+      p[ 0 ] = p[ 1 ] = p[ 2 ] = 0;
+    }
+}
+
+
+int main ( int argc, char **argv )
+{
+  const int width = 1680, height = 1080;
+  const int runs = (argc > 1 ? std::atoi( argv[ 1 ] ) : 20);
+
+  std::cout << std::setw( 8 ) << "kernel" << std::setw( 10 ) << "canvas" << std::setw( 12 ) << "ms/fill" << std::setw( 20 ) << "filled" << std::endl;
+  for( const char *canvas : { "blank", "grid" } )
+  {
+    for( const SpanKernel &kernel : spanKernels() )
+    {
+      Image image( width, height, 255, 255, 255 );
+      if( canvas[ 0 ] == 'g' )
+        drawGrid( image, 64 );
+
+      // alternate the colour, so each run fills the whole region again
+      SDL_Rect filled{ 0, 0, 0, 0 };
+      const auto start = std::chrono::steady_clock::now();
+      for( int k = 0; k < runs; ++k )
+        filled = floodFill( image, width/2 + 1, height/2 + 1, 255, std::uint8_t( 255*(k % 2) ), 0, 48, kernel );
+      const std::chrono::duration< double, std::milli > elapsed = std::chrono::steady_clock::now() - start;
+
+      std::cout << std::setw( 8 ) << kernel.name << std::setw( 10 ) << canvas
+                << std::setw( 12 ) << std::fixed << std::setprecision( 2 ) << (elapsed.count() / runs)
+                << std::setw( 20 ) << (std::to_string( filled.w ) + "x" + std::to_string( filled.h )) << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../brush.hh"
+#include "../image.hh"
+#include "../journal.hh"
+#include "../paint.hh"
+#include "../stroke.hh"
+#include "scribbles.hh"
+
+
+// collects the strokes of a journal; everything else is ignored
+class Recorder
+{
+  std::vector< std::pair< Pointer, RecordedStroke > > active_;
+  Brush brush_;
+  Uint8 r_ = 0, g_ = 0, b_ = 0;
+
+  std::vector< std::pair< Pointer, RecordedStroke > >::iterator find ( const Pointer &pointer )
+  {
+    return std::find_if( active_.begin(), active_.end(), [ &pointer ] ( const std::pair< Pointer, RecordedStroke > &s ) { return (s.first == pointer); } );
+  }
+
+public:
+  std::vector< RecordedStroke > strokes;
+
+  void down ( const Pointer &pointer, float x, float y )
+  {
+    active_.emplace_back( pointer, RecordedStroke{ { Stroke::Point{ x, y } }, brush_, r_, g_, b_ } );
+  }
+
+  void move ( const Pointer &pointer, float x, float y, float dx, float dy )
+  {
+    auto pos = find( pointer );
+    if( pos == active_.end() )
+      pos = active_.insert( active_.end(), std::make_pair( pointer, RecordedStroke{ { Stroke::Point{ x - dx, y - dy } }, brush_, r_, g_, b_ } ) );
+    pos->second.points.push_back( Stroke::Point{ x, y } );
+  }
+
+  void up ( const Pointer &pointer, float x, float y )
+  {
+    const auto pos = find( pointer );
+    if( pos == active_.end() )
+      return;
+    pos->second.points.push_back( Stroke::Point{ x, y } );
+    strokes.push_back( std::move( pos->second ) );
+    active_.erase( pos );
+  }
+
+  void setColor ( int r, int g, int b ) { r_ = Uint8( r ); g_ = Uint8( g ); b_ = Uint8( b ); }
+  void setBrush ( const Brush &brush ) { brush_ = brush; }
+
+  void clear () {}
+  void load ( const std::string & ) {}
+  void fill ( float, float ) {}
+  void selectLayer ( int ) {}
+  void open ( const std::string & ) {}
+  void restore ( std::istream & ) {}
+  void setView ( float, float, float ) {}
+  void undo () {}
+  void redo () {}
+};
+
+
+int main ( int argc, char **argv )
+{
+  const int width = 1680, height = 1080;
+
+  // bench-paint [journal [runs]]
+  std::vector< RecordedStroke > strokes;
+  if( argc > 1 )
+  {
+    std::ifstream in( argv[ 1 ], std::ios::binary );
+    Recorder recorder;
+    replay( in, recorder );
+    strokes = std::move( recorder.strokes );
+  }
+  else
+    strokes = scribbles( width, height );
+  const int runs = (argc > 2 ? std::atoi( argv[ 2 ] ) : 5);
+
+  std::size_t points = 0;
+  for( const RecordedStroke &stroke : strokes )
+    points += stroke.points.size();
+  std::cout << strokes.size() << " strokes, " << points << " points" << std::endl;
+
+  std::cout << std::setw( 12 ) << "rasterizer" << std::setw( 12 ) << "ms/run" << std::setw( 12 ) << "paints" << std::setw( 16 ) << "pixels" << std::setw( 12 ) << "checksum" << std::endl;
+  Brushes brushes;
+  for( const bool capsules : { false, true } )
+  {
+    Image image( width, height, 255, 255, 255 );
+    std::size_t paints = 0;
+    double pixels = 0.0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for( int k = 0; k < runs; ++k )
+    {
+      image.fill( 255, 255, 255 );
+      paints = 0;
+      pixels = 0.0;
+      for( const RecordedStroke &recorded : strokes )
+      {
+        Stroke::Parameters parameters;
+        parameters.continuous = capsules;
+        Stroke stroke( recorded.brush.radius, parameters );
+        const Stamp &stamp = brushes.stamp( recorded.brush );
+
+        auto painter = [ & ] ( float x, float y ) {
+            SDL_Rect rect;
+            if( capsules )
+              rect = paintCapsule( image, Capsule{ stroke.last(), Stroke::Point{ x, y }, recorded.brush.radius, recorded.brush.hardness }, recorded.r, recorded.g, recorded.b );
+            else
+              rect = paintStamp( image, stamp, int( std::floor( x + 0.5f ) ), int( std::floor( y + 0.5f ) ), recorded.r, recorded.g, recorded.b );
+            ++paints;
+            pixels += double( rect.w ) * double( rect.h );
+          };
+
+        stroke.begin( recorded.points.front(), painter );
+        for( std::size_t j = 1; j + 1 < recorded.points.size(); ++j )
+          stroke.extend( recorded.points[ j ], painter );
+        stroke.end( recorded.points.back(), painter );
+      }
+    }
+    const std::chrono::duration< double, std::milli > elapsed = std::chrono::steady_clock::now() - start;
+
+    std::uint32_t checksum = 0;
+    for( int y = 0; y < height; ++y )
+      for( int x = 0; x < width; ++x )
+        for( int c = 0; c < 4; ++c )
+          checksum = checksum * 31 + static_cast< const Image & >( image ).pixel( x, y )[ c ];
+
+    std::cout << std::setw( 12 ) << (capsules ? "capsules" : "stamps")
+              << std::setw( 12 ) << std::fixed << std::setprecision( 2 ) << (elapsed.count() / runs)
+              << std::setw( 12 ) << paints << std::setw( 16 ) << std::setprecision( 0 ) << pixels
+              << std::setw( 12 ) << std::hex << checksum << std::dec << std::endl;
+  }
+
+  return 0;
+}
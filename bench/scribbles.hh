@@ -0,0 +1,46 @@
+#ifndef BENCH_SCRIBBLES_HH
+#define BENCH_SCRIBBLES_HH
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include <SDL.h>
+
+#include "../brush.hh"
+#include "../stroke.hh"
+
+
+// a stroke with its brush and colour
+struct RecordedStroke
+{
+  std::vector< Stroke::Point > points;
+  Brush brush;
+  Uint8 r, g, b;
+};
+
+
+// deterministic scribbles with all brush sizes, sampled like mouse motion
+inline std::vector< RecordedStroke > scribbles ( int width, int height )
+{
+  std::vector< RecordedStroke > strokes;
+  for( int k = 0; k < 64; ++k )
+  {
+    RecordedStroke stroke;
+    stroke.brush.radius = float( 3 << (k % 4) );
+    stroke.brush.hardness = ((k % 8) < 4 ? 0.7f : 0.0f);
+    stroke.r = Uint8( 37*k );
+    stroke.g = Uint8( 91*k );
+    stroke.b = Uint8( 53*k );
+    const float cx = float( (k * 211) % width ), cy = float( (k * 137) % height );
+    for( int j = 0; j < 200; ++j )
+    {
+      const float t = 0.05f*j;
+      stroke.points.push_back( Stroke::Point{ cx + 150.0f*std::sin( t + k ), cy + 100.0f*std::sin( 1.7f*t ) } );
+    }
+    strokes.push_back( std::move( stroke ) );
+  }
+  return strokes;
+}
+
+#endif // #ifndef BENCH_SCRIBBLES_HH
@@ -0,0 +1,141 @@
+#include <cstdint>
+#include <cstdlib>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <regex>
+#include <string>
+
+#include "../atlas.hh"
+#include "../buttons/bucket.hh"
+#include "../buttons/clear.hh"
+#include "../buttons/color.hh"
+#include "../buttons/redo.hh"
+#include "../buttons/size.hh"
+#include "../buttons/undo.hh"
+#include "../canvas.hh"
+#include "../screen.hh"
+#include "../stats.hh"
+#include "../trace.hh"
+
+
+// FNV-1a hash of the pixels of the canvas, to check replays for correctness
+static std::uint64_t hash ( Canvas &canvas )
+{
+  const std::unique_ptr< std::uint8_t[] > pixels = canvas.pixels();
+  const std::size_t size = 4 * std::size_t( canvas.image().width() ) * std::size_t( canvas.image().height() );
+  std::uint64_t hash = 14695981039346656037u;
+  for( std::size_t k = 0; k < size; ++k )
+    hash = (hash ^ pixels[ k ]) * 1099511628211u;
+  return hash;
+}
+
+
+// replays a trace recorded by kidz-draw --trace=<file> through the event loop
+// of a headless screen of the same size, laid out like kidz-draw (except for
+// the snapshot button, which would write files)
+int main ( int argc, char **argv )
+{
+  // bench-trace <trace> [--capsules] [--low-latency] [--size=WxH]
+  if( argc < 2 )
+  {
+    std::cerr << "Usage: " << argv[ 0 ] << " <trace> [--capsules] [--low-latency] [--size=WxH]" << std::endl;
+    return 1;
+  }
+
+  try
+  {
+    std::ifstream in( argv[ 1 ], std::ios::binary );
+    if( !in )
+      throw std::runtime_error( "Unable to open trace '" + std::string( argv[ 1 ] ) + "'" );
+    TraceReader reader( in );
+
+    Screen::Headless headless;
+    headless.width = reader.width();
+    headless.height = reader.height();
+    Screen screen( headless );
+
+    Canvas::Rasterizer rasterizer = Canvas::Rasterizer::stamps;
+    const int columns = screen.columns(), rows = screen.rows();
+    int width = (columns-2)*screen.tileSize(), height = rows*screen.tileSize();
+    bool lowLatency = false;
+    for( int i = 2; i < argc; ++i )
+    {
+      const std::string option( argv[ i ] );
+      std::smatch size;
+      if( option == "--capsules" )
+        rasterizer = Canvas::Rasterizer::capsules;
+      else if( option == "--low-latency" )
+        lowLatency = true;
+      else if( std::regex_match( option, size, std::regex( "--size=([0-9]+)x([0-9]+)" ) ) )
+      {
+        // strtol saturates, so overlong numbers are out of range as well
+        const long w = std::strtol( size[ 1 ].str().c_str(), nullptr, 10 ), h = std::strtol( size[ 2 ].str().c_str(), nullptr, 10 );
+        if( (w <= Canvas::maxSize) && (h <= Canvas::maxSize) )
+        {
+          width = std::max( int( w ), width );
+          height = std::max( int( h ), height );
+        }
+        else
+          std::cerr << "Ignoring option '" << argv[ i ] << "' (at most " << Canvas::maxSize << " pixels each)" << std::endl;
+      }
+      else
+        std::cerr << "Ignoring unknown option '" << argv[ i ] << "'" << std::endl;
+    }
+
+    Canvas canvas( screen, 1, 0, columns-2, rows, width, height );
+    canvas.setRasterizer( rasterizer );
+    if( lowLatency )
+    {
+      screen.lowLatency = true;
+      canvas.setPrediction( 1.0f );
+    }
+
+    Atlas atlas( screen, 2, 9 );
+
+    ColorButton black( screen, atlas, 0, 0, canvas, 0, 0, 0 );
+    ColorButton violet( screen, atlas, 0, 1, canvas, 160, 0, 192 );
+    ColorButton blue( screen, atlas, 0, 2, canvas, 64, 64, 255 );
+    ColorButton green( screen, atlas, 0, 3, canvas, 0, 128, 32 );
+    ColorButton yellow( screen, atlas, 0, 4, canvas, 255, 255, 0 );
+    ColorButton orange( screen, atlas, 0, 5, canvas, 255, 128, 0 );
+    ColorButton red( screen, atlas, 0, 6, canvas, 255, 0, 0 );
+
+    ClearButton clear( screen, atlas, 0, 8, canvas );
+
+    UndoButton undo( screen, atlas, columns-1, 0, canvas );
+    RedoButton redo( screen, atlas, columns-1, 1, canvas );
+    BucketButton bucket( screen, atlas, columns-1, 2, canvas );
+
+    const float scale = float( screen.tileSize() ) / 120.0f;
+    SizeButton small( screen, atlas, columns-1, 3, canvas, 3.0f*scale );
+    SizeButton medium( screen, atlas, columns-1, 4, canvas, 6.0f*scale );
+    SizeButton large( screen, atlas, columns-1, 5, canvas, 12.0f*scale );
+    SizeButton soft( screen, atlas, columns-1, 6, canvas, 24.0f*scale, 0.0f );
+
+    const TraceStatistics statistics = screen.replay( reader );
+
+    std::cout << argv[ 1 ] << ": headless " << reader.width() << "x" << reader.height() << ", "
+              << (rasterizer == Canvas::Rasterizer::capsules ? "capsules" : "stamps") << (lowLatency ? ", low latency" : "") << std::endl;
+    std::cout << std::setw( 10 ) << "events" << std::setw( 12 ) << "recorded s" << std::setw( 12 ) << "replayed s"
+              << std::setw( 12 ) << "events/s" << std::setw( 10 ) << "frames" << std::setw( 12 ) << "ms (50%)"
+              << std::setw( 12 ) << "ms (90%)" << std::setw( 12 ) << "ms (99%)" << std::setw( 20 ) << "hash" << std::endl;
+    std::cout << std::setw( 10 ) << statistics.events
+              << std::setw( 12 ) << std::fixed << std::setprecision( 3 ) << (statistics.recorded / 1000.0)
+              << std::setw( 12 ) << statistics.replayed
+              << std::setw( 12 ) << std::setprecision( 0 ) << (statistics.events / statistics.replayed)
+              << std::setw( 10 ) << statistics.frames.size()
+              << std::setw( 12 ) << std::setprecision( 3 ) << percentile( statistics.frames, 50 )
+              << std::setw( 12 ) << percentile( statistics.frames, 90 )
+              << std::setw( 12 ) << percentile( statistics.frames, 99 )
+              << std::setw( 4 ) << "" << std::hex << std::setfill( '0' ) << std::setw( 16 ) << hash( canvas ) << std::endl;
+    return 0;
+  }
+  catch( const std::exception &e )
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
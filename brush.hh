@@ -0,0 +1,58 @@
+#ifndef BRUSH_HH
+#define BRUSH_HH
+
+#include <cmath>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "stamp.hh"
+
+
+// Brush
+// -----
+
+struct Brush
+{
+  static constexpr float maxRadius = 128.0f;
+
+  float radius = 6.0f;        // in pixels
+  float hardness = 0.7f;      // 0 = soft, 1 = hard
+};
+
+
+
+// Brushes
+// -------
+//
+// Cache of brush stamps, so switching between brushes does not cost anything
+// at stroke time. Radius and hardness are quantized, so brushes differing
+// only slightly share a stamp. The colour is applied by the composite kernel
+// and hence not part of the stamp.
+
+class Brushes
+{
+  typedef std::pair< int, int > Key;
+
+  std::map< Key, std::unique_ptr< Stamp > > stamps_;
+
+public:
+  // the reference remains valid as long as the cache does
+  const Stamp &stamp ( const Brush &brush )
+  {
+    const float radius = std::min( std::max( brush.radius, 0.5f ), float( Brush::maxRadius ) );
+    const float hardness = std::min( std::max( brush.hardness, 0.0f ), 1.0f );
+    const Key key( int( std::floor( 4.0f*radius + 0.5f ) ), int( std::floor( 64.0f*hardness + 0.5f ) ) );
+
+    std::unique_ptr< Stamp > &stamp = stamps_[ key ];
+    if( !stamp )
+      stamp.reset( new Stamp( 0.25f*key.first, key.second / 64.0f ) );
+    return *stamp;
+  }
+
+  std::size_t size () const { return stamps_.size(); }
+};
+
+#endif // #ifndef BRUSH_HH
@@ -0,0 +1,40 @@
+#ifndef BUTTONS_BUCKET_HH
+#define BUTTONS_BUCKET_HH
+
+#include <SDL.h>
+
+#include "../atlas.hh"
+#include "../canvas.hh"
+#include "../screen.hh"
+
+
+extern const std::uint8_t bucket_data[];
+extern const std::size_t bucket_size;
+
+
+// BucketButton
+// ------------
+//
+// The next touch on the canvas flood fills with the current colour.
+
+class BucketButton
+  : public Touchable
+{
+  Canvas &canvas_;
+
+public:
+  BucketButton ( Screen &screen, Atlas &atlas, int i, int j, Canvas &canvas )
+    : canvas_( canvas )
+  {
+    const SDL_Point cell = atlas.add( bucket_data, bucket_size );
+    screen.registerTile( i, j, atlas.texture(), this, cell.x, cell.y );
+  }
+
+  bool down ( float x, float y )
+  {
+    canvas_.selectBucket();
+    return false;
+  }
+};
+
+#endif // #ifndef BUTTONS_BUCKET_HH
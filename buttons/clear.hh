@@ -3,9 +3,9 @@
 
 #include <SDL.h>
 
+#include "../atlas.hh"
 #include "../canvas.hh"
 #include "../screen.hh"
-#include "../texture.hh"
 
 
 extern const std::uint8_t trash_data[];
@@ -16,20 +16,19 @@ extern const std::size_t trash_size;
 // -----------
 
 class ClearButton
-  : public Texture,
-    public Touchable
+  : public Touchable
 {
   Canvas &canvas_;
 
 public:
-  ClearButton ( Screen &screen, int i, int j, Canvas &canvas )
-    : Texture( screen, trash_data, trash_size ),
-      canvas_( canvas )
+  ClearButton ( Screen &screen, Atlas &atlas, int i, int j, Canvas &canvas )
+    : canvas_( canvas )
   {
-    screen.registerTile( i, j, texture_, this );
+    const SDL_Point cell = atlas.add( trash_data, trash_size );
+    screen.registerTile( i, j, atlas.texture(), this, cell.x, cell.y );
   }
 
-  bool down ( int x, int y )
+  bool down ( float x, float y )
   {
     canvas_.clear();
     return true;
@@ -3,32 +3,30 @@
 
 #include <SDL.h>
 
+#include "../atlas.hh"
 #include "../canvas.hh"
 #include "../screen.hh"
-#include "../texture.hh"
 
 
 // ColorButton
 // -----------
 
 class ColorButton
-  : public Texture,
-    public Touchable
+  : public Touchable
 {
   Canvas &canvas_;
   int r_, g_, b_;
 
 public:
-  ColorButton ( Screen &screen, int i, int j, Canvas &canvas, int r, int g, int b )
-    : Texture( screen, 120, 120, r, g, b ),
-      canvas_( canvas ),
+  ColorButton ( Screen &screen, Atlas &atlas, int i, int j, Canvas &canvas, int r, int g, int b )
+    : canvas_( canvas ),
       r_( r ), g_( g ), b_( b )
   {
-    //clear( mapRGB( r_, g_, b_ ) );
-    screen.registerTile( i, j, texture_, this );
+    const SDL_Point cell = atlas.add( r, g, b );
+    screen.registerTile( i, j, atlas.texture(), this, cell.x, cell.y );
   }
 
-  bool down ( int x, int y )
+  bool down ( float x, float y )
   {
     canvas_.setColor( r_, g_, b_ );
     return false;
@@ -0,0 +1,37 @@
+#ifndef BUTTONS_REDO_HH
+#define BUTTONS_REDO_HH
+
+#include <SDL.h>
+
+#include "../atlas.hh"
+#include "../canvas.hh"
+#include "../screen.hh"
+
+
+extern const std::uint8_t redo_data[];
+extern const std::size_t redo_size;
+
+
+// RedoButton
+// ----------
+
+class RedoButton
+  : public Touchable
+{
+  Canvas &canvas_;
+
+public:
+  RedoButton ( Screen &screen, Atlas &atlas, int i, int j, Canvas &canvas )
+    : canvas_( canvas )
+  {
+    const SDL_Point cell = atlas.add( redo_data, redo_size );
+    screen.registerTile( i, j, atlas.texture(), this, cell.x, cell.y );
+  }
+
+  bool down ( float x, float y )
+  {
+    return canvas_.redo();
+  }
+};
+
+#endif // #ifndef BUTTONS_REDO_HH
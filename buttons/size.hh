@@ -0,0 +1,59 @@
+#ifndef BUTTONS_SIZE_HH
+#define BUTTONS_SIZE_HH
+
+#include <cstdint>
+
+#include <algorithm>
+#include <vector>
+
+#include <SDL.h>
+
+#include "../atlas.hh"
+#include "../brush.hh"
+#include "../canvas.hh"
+#include "../composite.hh"
+#include "../screen.hh"
+
+
+// SizeButton
+// ----------
+//
+// Selects a brush; the button shows the brush's stamp in white on black.
+
+class SizeButton
+  : public Touchable
+{
+  Canvas &canvas_;
+  Brush brush_;
+
+public:
+  SizeButton ( Screen &screen, Atlas &atlas, int i, int j, Canvas &canvas, float radius, float hardness = Brush().hardness )
+    : canvas_( canvas )
+  {
+    brush_.radius = radius;
+    brush_.hardness = hardness;
+
+    const int size = atlas.cellSize();
+    std::vector< std::uint8_t > pixels( 4*size*size, 0 );
+    for( std::size_t k = 3; k < pixels.size(); k += 4 )
+      pixels[ k ] = 255;
+
+    // clip stamps larger than the button
+    const Stamp &stamp = canvas.brushes().stamp( brush_ );
+    const int w = std::min( stamp.width(), size ), h = std::min( stamp.height(), size );
+    const int sx = (stamp.width() - w) / 2, sy = (stamp.height() - h) / 2;
+    const int x = (size - w) / 2, y = (size - h) / 2;
+    compositeKernel().blend( pixels.data() + 4*(y*size + x), 4*size, stamp.coverage( sx, sy ), stamp.pitch(), w, h, 255, 255, 255 );
+
+    const SDL_Point cell = atlas.add( pixels.data() );
+    screen.registerTile( i, j, atlas.texture(), this, cell.x, cell.y );
+  }
+
+  bool down ( float x, float y )
+  {
+    canvas_.setBrush( brush_ );
+    return false;
+  }
+};
+
+#endif // #ifndef BUTTONS_SIZE_HH
@@ -5,13 +5,14 @@
 #include <cstddef>
 
 #include <iomanip>
+#include <memory>
 
 #include <SDL.h>
 
+#include "../atlas.hh"
 #include "../canvas.hh"
 #include "../screen.hh"
 #include "../snapshots.hh"
-#include "../texture.hh"
 
 
 extern const std::uint8_t camera_data[];
@@ -22,26 +23,38 @@ extern const std::size_t camera_size;
 // --------------
 
 class SnapShotButton
-  : public Texture,
-    public Touchable
+  : public Touchable
 {
+  Screen &screen_;
   Canvas &canvas_;
   SnapShots &snapShots_;
 
 public:
-  SnapShotButton ( Screen &screen, int i, int j, Canvas &canvas, SnapShots &snapShots )
-    : Texture( screen, camera_data, camera_size ),
+  SnapShotButton ( Screen &screen, Atlas &atlas, int i, int j, Canvas &canvas, SnapShots &snapShots )
+    : screen_( screen ),
       canvas_( canvas ),
       snapShots_( snapShots )
   {
-    screen.registerTile( i, j, texture_, this );
+    const SDL_Point cell = atlas.add( camera_data, camera_size );
+    screen.registerTile( i, j, atlas.texture(), this, cell.x, cell.y );
   }
 
-  bool down ( int x, int y )
+  // the drawing is copied at the tap, but only encoded once the input of the
+  // frame is handled
+  bool down ( float x, float y )
+  {
+    auto image = std::make_shared< Image >( canvas_.copy() );
+    if( !screen_.pushTask( [ this, image ] () { return save( *image ); } ) )
+      save( *image );
+    return false;
+  }
+
+private:
+  bool save ( Image &image )
   {
     try
     {
-      canvas_.save( snapShots_.newSnapShot() );
+      Canvas::save( image, snapShots_.newSnapShot() );
       return false;
     }
     catch( std::exception )
@@ -0,0 +1,37 @@
+#ifndef BUTTONS_UNDO_HH
+#define BUTTONS_UNDO_HH
+
+#include <SDL.h>
+
+#include "../atlas.hh"
+#include "../canvas.hh"
+#include "../screen.hh"
+
+
+extern const std::uint8_t undo_data[];
+extern const std::size_t undo_size;
+
+
+// UndoButton
+// ----------
+
+class UndoButton
+  : public Touchable
+{
+  Canvas &canvas_;
+
+public:
+  UndoButton ( Screen &screen, Atlas &atlas, int i, int j, Canvas &canvas )
+    : canvas_( canvas )
+  {
+    const SDL_Point cell = atlas.add( undo_data, undo_size );
+    screen.registerTile( i, j, atlas.texture(), this, cell.x, cell.y );
+  }
+
+  bool down ( float x, float y )
+  {
+    return canvas_.undo();
+  }
+};
+
+#endif // #ifndef BUTTONS_UNDO_HH
@@ -1,71 +1,1097 @@
 #ifndef CANVAS_HH
 #define CANVAS_HH
 
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <SDL.h>
 
+#include "brush.hh"
+#include "composite.hh"
+#include "fill.hh"
+#include "history.hh"
+#include "image.hh"
+#include "journal.hh"
+#include "paint.hh"
+#include "palette.hh"
+#include "png.hh"
+#include "pyramid.hh"
+#include "rle.hh"
 #include "screen.hh"
+#include "stamp.hh"
+#include "stroke.hh"
 #include "texture.hh"
 
 
-extern const std::uint8_t pen_small_data[];
-extern const std::size_t pen_small_size;
-
-
 // Canvas
 // ------
+//
+// All painting is done on the CPU into a stack of layers: an opaque
+// background (e.g., a loaded snapshot) and transparent drawing layers above
+// it, holding premultiplied pixels. Stamps are recorded and applied once per
+// frame to the current drawing layer. The layers are flattened into image_,
+// which is recomposited only inside damaged rectangles and then uploaded to
+// the texture. Reading the canvas (e.g., saving) never touches the layers or
+// the GPU.
+//
+// Strokes are either stamped or drawn as a sequence of anti-aliased capsules,
+// which touches each pixel only once per segment (see Rasterizer).
+//
+// The canvas may be larger than its texture, which then shows a view of it
+// that can be panned and zoomed with two fingers. Only the visible tiles and
+// those used recently stay resident; all others are paged out (see Image).
+// Zoomed out views are sampled from a Pyramid.
+//
+// The canvas holds several named sessions (e.g., one per child), only one of
+// which is shown. The drawings of the others are kept paged out, i.e., run-
+// length encoded in memory, so switching sessions swaps a few containers and
+// then decodes just the visible tiles.
+//
+// Each undo step spans from the first pointer going down to the last one
+// going up; clearing and loading are steps of their own. Loading replaces the
+// background and erases the drawing layers. Clearing erases the drawing
+// layers, or the background if they are blank already. If a journal is
+// attached, all input mutating the canvas is recorded into it.
 
 class Canvas
   : public Texture,
     public Touchable
 {
-  Texture pen_;
+public:
+  enum class Rasterizer { stamps, capsules };
+
+private:
+  // the drawing of a session not shown
+  struct Session
+  {
+    Image image;
+    std::vector< Image > layers, levels;
+    int layer;
+    History history;
+    float x, y, zoom;
+    std::shared_ptr< std::string > png;   // encoded by the last checkpoint (see restartJournal)
+  };
+
+  // a stamp at to or a capsule from from to to
+  struct PaintCommand
+  {
+    Stroke::Point from, to;
+    Uint8 r, g, b;
+    const Stamp *stamp;         // nullptr for capsules
+    float radius, hardness;
+  };
 
-  void paint ( int x, int y )
+  Image image_;                   // the flattened layers
+  std::vector< Image > layers_;   // background first, then drawing layers
+  int layer_ = 1;                 // the drawing layer painted on
+  Pyramid pyramid_;
+  History history_;
+  Brushes brushes_;
+  Brush brush_;
+  const Stamp *stamp_;
+  Stroke stroke_;   // prototype for the strokes of all pointers
+  std::vector< std::pair< Pointer, Stroke > > strokes_;
+  Uint8 r_ = 0, g_ = 0, b_ = 0;
+
+  // the view shows the image from (x_, y_) on at zoom_; dirty_ holds the
+  // rectangles to upload per tile of the texture
+  float x_ = 0.0f, y_ = 0.0f, zoom_ = 1.0f;
+  std::vector< SDL_Rect > dirty_;
+  std::vector< std::uint8_t > upload_;
+
+  Rasterizer rasterizer_ = Rasterizer::stamps;
+  std::vector< PaintCommand > paints_;
+  Journal *journal_ = nullptr;
+
+  bool bucket_ = false;
+  std::vector< Pointer > ignored_;   // pointers whose touch filled or zoomed, ignored until up
+
+  // two pointers panning and zooming, with their positions in the view
+  std::vector< std::pair< Pointer, Stroke::Point > > gesture_;
+
+  std::string session_ = "default";
+  std::map< std::string, Session > sessions_;
+
+  // predicted extensions of the strokes in progress are painted into the
+  // current layer for one frame; predicted_ holds the tiles they replaced
+  float prediction_ = 0.0f;
+  std::vector< std::pair< int, Image::SharedTile > > predicted_;
+  SDL_Rect predictedRect_ = SDL_Rect{ 0, 0, 0, 0 };
+  int predictedLayer_ = 1;
+
+  int tilesX () const { return (width_ + Image::tileSize-1) / Image::tileSize; }
+
+  // mark a rectangle of the texture for upload
+  void damageView ( const SDL_Rect &rect )
   {
-    blit( x - pen_.width()/2, y - pen_.height()/2, pen_ );
+    SDL_Rect view;
+    if( !intersect( rect, SDL_Rect{ 0, 0, width_, height_ }, view ) )
+      return;
+    for( int j = view.y / Image::tileSize; j*Image::tileSize < view.y + view.h; ++j )
+    {
+      for( int i = view.x / Image::tileSize; i*Image::tileSize < view.x + view.w; ++i )
+      {
+        SDL_Rect part;
+        intersect( view, SDL_Rect{ i*Image::tileSize, j*Image::tileSize, Image::tileSize, Image::tileSize }, part );
+        unite( dirty_[ j*tilesX() + i ], part );
+      }
+    }
+  }
+
+  void trimLayers ()
+  {
+    image_.trim();
+    for( Image &layer : layers_ )
+      layer.trim();
+  }
+
+  // recomposite a rectangle of the flattened image; tiles without any drawing
+  // share the background tile. Large rectangles are trimmed row by row.
+  void flatten ( const SDL_Rect &rect )
+  {
+    SDL_Rect area;
+    if( !intersect( rect, image_.rect(), area ) )
+      return;
+
+    const Image &background = layers_.front();
+    std::vector< const Image * > drawn;
+    for( int j = area.y / Image::tileSize; j*Image::tileSize < area.y + area.h; ++j )
+    {
+      for( int i = area.x / Image::tileSize; i*Image::tileSize < area.x + area.w; ++i )
+      {
+        const int k = j*image_.tilesX() + i;
+        drawn.clear();
+        for( std::size_t l = 1; l < layers_.size(); ++l )
+        {
+          if( !layers_[ l ].tile( k )->transparent() )
+            drawn.push_back( &layers_[ l ] );
+        }
+        if( drawn.empty() )
+        {
+          image_.setTile( k, background.tile( k ) );
+          continue;
+        }
+
+        SDL_Rect part;
+        intersect( area, image_.tileRect( k ), part );
+        image_.modifyTiles( part, [ &background, &drawn ] ( std::uint8_t *dst, int pitch, const SDL_Rect &part ) {
+            background.read( part, dst, pitch );
+            for( const Image *layer : drawn )
+            {
+              layer->forEachTile( part, [ dst, pitch ] ( const std::uint8_t *src, int srcPitch, const SDL_Rect &part ) {
+                  compositeOver( dst, pitch, src, srcPitch, part.w, part.h );
+                } );
+            }
+          } );
+      }
+      if( area.h > Image::tileSize )
+        trimLayers();
+    }
+  }
+
+  // report a modified rectangle of the layers
+  void damage ( const SDL_Rect &rect )
+  {
+    flatten( rect );
+    pyramid_.update( rect );
+    const int x0 = int( std::floor( (rect.x - x_) * zoom_ ) ) - 1, x1 = int( std::ceil( (rect.x + rect.w - x_) * zoom_ ) ) + 1;
+    const int y0 = int( std::floor( (rect.y - y_) * zoom_ ) ) - 1, y1 = int( std::ceil( (rect.y + rect.h - y_) * zoom_ ) ) + 1;
+    damageView( SDL_Rect{ x0, y0, x1 - x0, y1 - y0 } );
+  }
+
+  // map a position in the view into the image
+  Stroke::Point toImage ( float x, float y ) const { return Stroke::Point{ x_ + x / zoom_, y_ + y / zoom_ }; }
+  Stroke::Point toView ( Stroke::Point p ) const { return Stroke::Point{ (p.x - x_) * zoom_, (p.y - y_) * zoom_ }; }
+
+  // upload a rectangle of the view to the texture
+  void upload ( const SDL_Rect &rect )
+  {
+    // at 1:1, the view is aligned to the pixels of the image (see setView)
+    if( zoom_ == 1.0f )
+    {
+      const int x = int( x_ ), y = int( y_ );
+      image_.forEachTile( SDL_Rect{ rect.x + x, rect.y + y, rect.w, rect.h }, [ this, x, y ] ( const std::uint8_t *pixels, int pitch, const SDL_Rect &part ) {
+          const SDL_Rect dst{ part.x - x, part.y - y, part.w, part.h };
+          SDL_UpdateTexture( texture_, &dst, pixels, pitch );
+        } );
+      return;
+    }
+
+    upload_.resize( 4*rect.w*rect.h );
+    pyramid_.render( x_, y_, zoom_, rect, upload_.data(), 4*rect.w );
+    SDL_UpdateTexture( texture_, &rect, upload_.data(), 4*rect.w );
+  }
+
+  // keep the visible tiles of the level shown resident, paging out others
+  void trim ()
+  {
+    const int shown = pyramid_.levelAt( zoom_ );
+    for( int l = 0; l < pyramid_.levels(); ++l )
+    {
+      const float scale = 1.0f / float( 1 << l );
+      const SDL_Rect visible{ int( std::floor( x_ * scale ) ) - 1, int( std::floor( y_ * scale ) ) - 1,
+                              int( std::ceil( width_ / zoom_ * scale ) ) + 3, int( std::ceil( height_ / zoom_ * scale ) ) + 3 };
+      pyramid_.level( l ).pin( l == shown ? visible : SDL_Rect{ 0, 0, 0, 0 } );
+    }
+    // the layers are painted where visible
+    for( Image &layer : layers_ )
+    {
+      layer.pin( pyramid_.level( 0 ).pinned() );
+      layer.trim();
+    }
+    pyramid_.trim();
+  }
+
+  Image &layer () { return layers_[ layer_ ]; }
+
+  // erase the drawing layers, damaging the tiles drawn on; returns false if
+  // they were blank already
+  bool eraseLayers ()
+  {
+    std::vector< bool > drawn( image_.tileCount(), false );
+    for( auto layer = layers_.begin()+1; layer != layers_.end(); ++layer )
+    {
+      for( int k = 0; k < layer->tileCount(); ++k )
+      {
+        const Image::SharedTile tile = layer->tile( k );
+        tile->data();
+        drawn[ k ] = drawn[ k ] || !tile->transparent();
+      }
+      layer->fill( 0, 0, 0, 0 );
+    }
+
+    // damage row by row, trimming in between
+    bool erased = false;
+    for( int j = 0; j < image_.tilesY(); ++j )
+    {
+      const auto row = drawn.begin() + j*image_.tilesX();
+      const auto first = std::find( row, row + image_.tilesX(), true );
+      if( first == row + image_.tilesX() )
+        continue;
+      const auto last = std::find( std::make_reverse_iterator( row + image_.tilesX() ), std::make_reverse_iterator( first ), true );
+      SDL_Rect rect = image_.tileRect( int( first - row ), j );
+      unite( rect, image_.tileRect( int( last.base() - row ) - 1, j ) );
+      damage( rect );
+      trim();
+      erased = true;
+    }
+    return erased;
+  }
+
+  bool zoomable () const { return (image_.width() > width_) || (image_.height() > height_); }
+
+  float minZoom () const { return std::min( std::max( float( width_ ) / image_.width(), float( height_ ) / image_.height() ), 1.0f ); }
+
+  void paint ( const Stroke &stroke, float x, float y )
+  {
+    if( rasterizer_ == Rasterizer::capsules )
+      paints_.push_back( PaintCommand{ stroke.last(), Stroke::Point{ x, y }, r_, g_, b_, nullptr, brush_.radius, brush_.hardness } );
+    else
+      paints_.push_back( PaintCommand{ Stroke::Point{ x, y }, Stroke::Point{ x, y }, r_, g_, b_, stamp_, 0.0f, 0.0f } );
+  }
+
+  auto painter ( const Stroke &stroke ) { return [ this, &stroke ] ( float x, float y ) { paint( stroke, x, y ); }; }
+
+  std::vector< std::pair< Pointer, Stroke > >::iterator find ( const Pointer &pointer )
+  {
+    return std::find_if( strokes_.begin(), strokes_.end(), [ &pointer ] ( const std::pair< Pointer, Stroke > &s ) { return (s.first == pointer); } );
+  }
+
+  Stroke &stroke ( const Pointer &pointer )
+  {
+    auto pos = find( pointer );
+    if( pos != strokes_.end() )
+      return pos->second;
+    if( strokes_.empty() )
+      beginStep();
+    strokes_.emplace_back( pointer, stroke_ );
+    return strokes_.back().second;
+  }
+
+  // restore the tiles overwritten by the prediction
+  void retract ()
+  {
+    if( predicted_.empty() )
+      return;
+    for( std::pair< int, Image::SharedTile > &tile : predicted_ )
+      layers_[ predictedLayer_ ].setTile( tile.first, std::move( tile.second ) );
+    predicted_.clear();
+    damage( predictedRect_ );
+  }
+
+  // paint each stroke in progress from its last stamp to its current input
+  // point, and on along its last input segment, by prediction_ times its
+  // length (at most maxPrediction pixels); it is retracted before anything
+  // else touches the layers
+  void predict ()
+  {
+    std::vector< Capsule > capsules;
+    for( const std::pair< Pointer, Stroke > &s : strokes_ )
+    {
+      const Stroke &stroke = s.second;
+      if( stroke.count() < 2 )
+        continue;
+      const Stroke::Point a = stroke.last(), b = stroke.current(), p = stroke.previous();
+      float dx = (b.x - p.x) * prediction_, dy = (b.y - p.y) * prediction_;
+      const float length = std::sqrt( dx*dx + dy*dy );
+      if( length > maxPrediction )
+      {
+        dx *= maxPrediction / length;
+        dy *= maxPrediction / length;
+      }
+      capsules.push_back( Capsule{ a, b, brush_.radius, brush_.hardness } );
+      capsules.push_back( Capsule{ b, Stroke::Point{ b.x + dx, b.y + dy }, brush_.radius, brush_.hardness } );
+    }
+    if( capsules.empty() )
+      return;
+
+    SDL_Rect rect = capsules.front().bounds();
+    for( const Capsule &capsule : capsules )
+      unite( rect, capsule.bounds() );
+    if( !intersect( rect, image_.rect(), rect ) )
+      return;
+
+    Image &layer = this->layer();
+    for( int j = rect.y / Image::tileSize; j*Image::tileSize < rect.y + rect.h; ++j )
+    {
+      for( int i = rect.x / Image::tileSize; i*Image::tileSize < rect.x + rect.w; ++i )
+        predicted_.emplace_back( j*layer.tilesX() + i, layer.tile( j*layer.tilesX() + i ) );
+    }
+    predictedRect_ = rect;
+    predictedLayer_ = layer_;
+    for( const Capsule &capsule : capsules )
+      paintCapsule( layer, capsule, r_, g_, b_ );
+    damage( rect );
+  }
+
+  // apply recorded commands to the image
+  void apply ()
+  {
+    retract();
+    for( const PaintCommand &command : paints_ )
+    {
+      if( command.stamp )
+        damage( paintStamp( layer(), *command.stamp, int( std::floor( command.to.x + 0.5f ) ), int( std::floor( command.to.y + 0.5f ) ), command.r, command.g, command.b ) );
+      else
+        damage( paintCapsule( layer(), Capsule{ command.from, command.to, command.radius, command.hardness }, command.r, command.g, command.b ) );
+    }
+    screen_->frameStatistics().blits += paints_.size();
+    paints_.clear();
+  }
+
+  void beginStep ()
+  {
+    apply();
+    history_.begin( layers_ );
+  }
+
+  void endStep ()
+  {
+    apply();
+    history_.commit( layers_ );
+  }
+
+  // perform f as an undo step of its own, interrupting the strokes in progress
+  template< class F >
+  void step ( F &&f )
+  {
+    const bool drawing = history_.recording();
+    if( drawing )
+      endStep();
+    beginStep();
+    f();
+    endStep();
+    if( drawing )
+      beginStep();
+  }
+
+  // is the pointer's touch ignored? (forget about the pointer on release)
+  bool ignore ( const Pointer &pointer, bool release )
+  {
+    auto pos = std::find( ignored_.begin(), ignored_.end(), pointer );
+    if( pos == ignored_.end() )
+      return false;
+    if( release )
+      ignored_.erase( pos );
+    return true;
+  }
+
+  std::vector< std::pair< Pointer, Stroke::Point > >::iterator findGesture ( const Pointer &pointer )
+  {
+    return std::find_if( gesture_.begin(), gesture_.end(), [ &pointer ] ( const std::pair< Pointer, Stroke::Point > &g ) { return (g.first == pointer); } );
+  }
+
+  // a second finger turns a stroke just begun into a gesture; the stroke is
+  // discarded (see gestureDelay)
+  void beginGesture ( const Pointer &pointer, float x, float y )
+  {
+    const std::pair< Pointer, Stroke > &first = strokes_.front();
+    gesture_.emplace_back( first.first, toView( first.second.current() ) );
+    gesture_.emplace_back( pointer, Stroke::Point{ x, y } );
+    strokes_.clear();
+    paints_.clear();
+    retract();
+    history_.rollback( layers_, [ this ] ( const SDL_Rect &rect ) { damage( rect ); } );
+  }
+
+  // keep the point of the image between both fingers beneath them, zooming
+  // by the change of their distance
+  void moveGesture ( std::vector< std::pair< Pointer, Stroke::Point > >::iterator pos, float x, float y )
+  {
+    const Stroke::Point a = gesture_[ 0 ].second, b = gesture_[ 1 ].second;
+    pos->second = Stroke::Point{ x, y };
+    const Stroke::Point c = gesture_[ 0 ].second, d = gesture_[ 1 ].second;
+
+    const float before = std::hypot( b.x - a.x, b.y - a.y ), after = std::hypot( d.x - c.x, d.y - c.y );
+    const float zoom = (before >= 1.0f ? zoom_ * after / std::max( before, 1.0f ) : zoom_);
+    const Stroke::Point anchor = toImage( 0.5f*(a.x + b.x), 0.5f*(a.y + b.y) );
+    setView( anchor, Stroke::Point{ 0.5f*(c.x + d.x), 0.5f*(c.y + d.y) }, zoom );
+  }
+
+  // the strokes in progress are finished by an undo or redo
+  void finishStrokes ()
+  {
+    if( !history_.recording() )
+      return;
+    strokes_.clear();
+    endStep();
+  }
+
+  // a blank drawing of the size of the current one
+  Session blankSession () const
+  {
+    const int width = image_.width(), height = image_.height();
+    Session session{ Image( width, height, 255, 255, 255 ), {}, {}, 1, History( history_.capacity() ), 0.0f, 0.0f, 1.0f };
+    session.image.setCapacity( residentTiles );
+    session.layers = { session.image, Image( width, height, 0, 0, 0, 0 ) };
+    for( Image &layer : session.layers )
+      layer.setCapacity( residentLayerTiles );
+    for( int l = 1; l < pyramid_.levels(); ++l )
+    {
+      session.levels.emplace_back( pyramid_.level( l ).width(), pyramid_.level( l ).height(), 255, 255, 255 );
+      session.levels.back().setCapacity( residentLevelTiles );
+    }
+    return session;
+  }
+
+  // exchange the drawing shown with that of a session
+  void swap ( Session &session )
+  {
+    using std::swap;
+    swap( image_, session.image );
+    swap( layers_, session.layers );
+    pyramid_.swap( session.levels );
+    swap( layer_, session.layer );
+    swap( history_, session.history );
+    swap( x_, session.x );
+    swap( y_, session.y );
+    swap( zoom_, session.zoom );
+  }
+
+  static void pageOut ( Session &session )
+  {
+    session.image.pageOut();
+    for( Image &layer : session.layers )
+      layer.pageOut();
+    for( Image &level : session.levels )
+      level.pageOut();
+  }
+
+  // encode row band by row band, so the image is never linearized. Drawings
+  // mostly fit into a palette, which quarters the data to be compressed. It
+  // is collected from the tiles' encodings without decoding them, or from the
+  // pixels of tiles written since, without encoding them; tiles shared by
+  // consecutive positions are visited once, and collecting stops as soon as
+  // the palette overflows.
+  static void save ( Image &image, std::ostream &out )
+  {
+    const int width = image.width(), height = image.height();
+
+    Palette palette;
+    bool indexed = true;
+    for( int k = 0; indexed && (k < image.tileCount()); ++k )
+    {
+      const Image::SharedTile tile = image.tile( k );
+      if( (k == 0) || (tile != image.tile( k-1 )) )
+        indexed = tile->collect( palette );
+    }
+
+    png::output png_out( out );
+    png::info_t info = png_out.create_info( width, height, 8, indexed ? png::color_type_t::palette : png::color_type_t::rgb_alpha );
+    if( indexed )
+      png_out.set_palette( info, palette.data(), palette.size() );
+    png_out.write_info( std::move( info ) );
+
+    const int pitch = (indexed ? width : 4*width);
+    std::unique_ptr< png::byte_t[] > band( new png::byte_t[ 4*width*Image::tileSize ] );
+    std::unique_ptr< png::byte_t[] > indices( indexed ? new png::byte_t[ width*Image::tileSize ] : nullptr );
+    std::unique_ptr< png::byte_t *[] > rows( new png::byte_t *[ Image::tileSize ] );
+    for( int y = 0; y < Image::tileSize; ++y )
+      rows[ y ] = (indexed ? indices : band).get() + pitch*y;
+    for( int y = 0; y < height; y += Image::tileSize )
+    {
+      const SDL_Rect rect{ 0, y, width, std::min( int( Image::tileSize ), height - y ) };
+      image.read( rect, band.get(), 4*width );
+      if( indexed )
+        palette.index( band.get(), width*rect.h, indices.get() );
+      png_out.write_rows( rows.get(), rect.h );
+      image.trim();
+    }
+
+    png_out.write_end();
   }
 
 public:
+  static constexpr float maxZoom = 8.0f;
+
+  // a second finger starts a gesture, if the first one moved at most this
+  // many input points; later, both fingers draw
+  static constexpr int gestureDelay = 8;
+
+  // number of tiles kept resident besides the visible ones, per pyramid level
+  // and layer
+  static constexpr std::size_t residentTiles = 512;
+  static constexpr std::size_t residentLevelTiles = 64;
+  static constexpr std::size_t residentLayerTiles = 128;
+
+  static constexpr int maxLayers = 8;
+
+  // maximum width and height of the image (in pixels)
+  static constexpr int maxSize = 32768;
+
+  // maximum length of the predicted extension of a stroke (in pixels)
+  static constexpr float maxPrediction = 64.0f;
+
   Canvas ( Screen &screen, int i, int j, int w, int h )
-    : Texture( screen, w*120, h*120, Texture::Access::Target ),
-      pen_( screen, pen_small_data, pen_small_size )
+    : Canvas( screen, i, j, w, h, w*screen.tileSize(), h*screen.tileSize() )
+  {}
+
+  // canvas of width x height pixels, viewed through the given tiles; the
+  // view has the resolution of the screen, so it is never scaled
+  Canvas ( Screen &screen, int i, int j, int w, int h, int width, int height )
+    : Texture( screen, w*screen.tileSize(), h*screen.tileSize(), Texture::Access::Streaming ),
+      image_( width, height, 255, 255, 255 ),
+      layers_{ image_, Image( width, height, 0, 0, 0, 0 ) },
+      pyramid_( image_, width_, height_ ),
+      stamp_( &brushes_.stamp( brush_ ) ),
+      stroke_( brush_.radius ),
+      dirty_( tilesX()*((height_ + Image::tileSize-1) / Image::tileSize), SDL_Rect{ 0, 0, 0, 0 } )
   {
-    clear();
+    image_.setCapacity( residentTiles );
+    for( Image &layer : layers_ )
+      layer.setCapacity( residentLayerTiles );
+    for( int l = 1; l < pyramid_.levels(); ++l )
+      pyramid_.level( l ).setCapacity( residentLevelTiles );
+    setView( 0.0f, 0.0f, 1.0f );
     setColor( 0, 0, 0 );
     screen.registerTiles( i, j, w, h, texture_, this );
+    screen.registerFlushable( this );
+  }
+
+  void clear ()
+  {
+    if( journal_ )
+      journal_->recordClear();
+    step( [ this ] () {
+        if( eraseLayers() )
+          return;
+        layers_.front().fill( 255, 255, 255 );
+        image_.fill( 255, 255, 255 );
+        pyramid_.fill( 255, 255, 255 );
+        damageView( SDL_Rect{ 0, 0, width_, height_ } );
+      } );
+    if( journal_ )
+      restartJournal();
+  }
+
+  bool undo ()
+  {
+    if( journal_ )
+      journal_->recordUndo();
+    finishStrokes();
+    return history_.undo( layers_, [ this ] ( const SDL_Rect &rect ) { damage( rect ); } );
+  }
+
+  bool redo ()
+  {
+    if( journal_ )
+      journal_->recordRedo();
+    finishStrokes();
+    return history_.redo( layers_, [ this ] ( const SDL_Rect &rect ) { damage( rect ); } );
   }
 
-  void clear () { Texture::clear( 255, 255, 255 ); }
+  History &history () { return history_; }
+  const History &history () const { return history_; }
+
+  // attach a journal (nullptr to detach)
+  void setJournal ( Journal *journal ) { journal_ = journal; }
 
   void setColor ( int r, int g, int b )
   {
-    pen_.setColorMod( r, g, b );
+    if( journal_ )
+      journal_->recordColor( r, g, b );
+    r_ = r;
+    g_ = g;
+    b_ = b;
   }
 
-  // Touchable
+  // name of the session shown
+  const std::string &session () const { return session_; }
+
+  // show the session of the given name, starting a blank one if there is none
+  // yet; strokes in progress are finished and gestures abandoned
+  void open ( const std::string &session )
+  {
+    if( session == session_ )
+      return;
+    if( journal_ )
+      journal_->recordOpen( session );
+
+    finishStrokes();
+    for( const std::pair< Pointer, Stroke::Point > &g : gesture_ )
+      ignored_.push_back( g.first );
+    gesture_.clear();
+
+    const auto pos = sessions_.find( session );
+    Session next = (pos != sessions_.end() ? std::move( pos->second ) : blankSession());
+    if( pos != sessions_.end() )
+      sessions_.erase( pos );
+    swap( next );
+    pageOut( next );
+    next.png.reset();
+    sessions_.emplace( session_, std::move( next ) );
+    session_ = session;
+    setView( x_, y_, zoom_ );
+  }
 
-  bool down ( int x, int y ) { paint( x, y ); return true; }
-  bool up ( int x, int y ) { paint( x, y ); return true; }
+  // the flattened layers
+  const Image &image () const { return image_; }
 
-  bool move ( int x, int y, int dx, int dy )
+  // a copy of the flattened layers with all strokes applied; it shares the
+  // tiles, which drawing later unshares (e.g., to save the drawing later on)
+  Image copy ()
   {
-    const int dz = std::max( std::abs( dx ), std::abs( dy ) );
-    int ex = dz;
-    int ey = dz;
-    for( int i = 0; i < dz; ++i )
+    apply();
+    return image_;
+  }
+
+  const std::vector< Image > &layers () const { return layers_; }
+  int currentLayer () const { return layer_; }
+
+  // low-latency ink: extend the strokes in progress by prediction times their
+  // last input segment until the next input arrives (0 to disable)
+  void setPrediction ( float prediction ) { prediction_ = std::max( prediction, 0.0f ); }
+  float prediction () const { return prediction_; }
+
+  // paint on drawing layer k (1 to maxLayers), adding blank layers as needed;
+  // the undo step in progress ends here, as it cannot hold layers added later
+  void selectLayer ( int k )
+  {
+    k = std::min( std::max( k, 1 ), maxLayers );
+    if( journal_ )
+      journal_->recordLayer( k );
+    const bool drawing = history_.recording();
+    if( drawing )
+      endStep();
+    else
+      apply();
+    while( int( layers_.size() ) <= k )
     {
-      paint( x, y );
-      if( (ex -= 2*std::abs( dx )) < 0 )
-      {
-        ex += 2*dz;
-        x -= (dx < 0 ? -1 : 1);
-      }
-      if( (ey -= 2*std::abs( dy )) < 0 )
+      layers_.emplace_back( image_.width(), image_.height(), 0, 0, 0, 0 );
+      layers_.back().setCapacity( residentLayerTiles );
+    }
+    layer_ = k;
+    if( drawing )
+      beginStep();
+  }
+  const Pyramid &pyramid () const { return pyramid_; }
+
+  // the view shows the image from (x, y) on; it is clamped to the image and
+  // aligned to whole pixels of the view
+  float viewX () const { return x_; }
+  float viewY () const { return y_; }
+  float zoom () const { return zoom_; }
+
+  void setView ( float x, float y, float zoom )
+  {
+    zoom_ = std::min( std::max( zoom, minZoom() ), maxZoom );
+    x_ = std::min( std::max( std::floor( x * zoom_ + 0.5f ) / zoom_, 0.0f ), std::max( image_.width() - width_ / zoom_, 0.0f ) );
+    y_ = std::min( std::max( std::floor( y * zoom_ + 0.5f ) / zoom_, 0.0f ), std::max( image_.height() - height_ / zoom_, 0.0f ) );
+    damageView( SDL_Rect{ 0, 0, width_, height_ } );
+  }
+
+  // zoom, moving the point anchor of the image to the point p of the view
+  void setView ( Stroke::Point anchor, Stroke::Point p, float zoom )
+  {
+    zoom = std::min( std::max( zoom, minZoom() ), maxZoom );
+    setView( anchor.x - p.x / zoom, anchor.y - p.y / zoom, zoom );
+  }
+
+  // strokes already in progress keep their spacing
+  const Brush &brush () const { return brush_; }
+  void setBrush ( const Brush &brush )
+  {
+    if( journal_ )
+      journal_->recordBrush( brush.radius, brush.hardness );
+    brush_ = brush;
+    stamp_ = &brushes_.stamp( brush_ );
+    stroke_.setRadius( brush_.radius );
+  }
+
+  Brushes &brushes () { return brushes_; }
+
+  Rasterizer rasterizer () const { return rasterizer_; }
+  void setRasterizer ( Rasterizer rasterizer )
+  {
+    rasterizer_ = rasterizer;
+    Stroke::Parameters parameters = strokeParameters();
+    parameters.continuous = (rasterizer == Rasterizer::capsules);
+    setStrokeParameters( parameters );
+  }
+
+  const Stroke::Parameters &strokeParameters () const { return stroke_.parameters(); }
+  void setStrokeParameters ( const Stroke::Parameters &parameters )
+  {
+    stroke_.setParameters( parameters );
+    for( auto &s : strokes_ )
+      s.second.setParameters( parameters );
+  }
+
+  std::unique_ptr< std::uint8_t[] > pixels ()
+  {
+    apply();
+    return image_.pixels();
+  }
+
+  // load a PNG into the top left corner of the background, row band by row
+  // band, so neither the PNG nor the image is ever held in memory as a whole
+  void load ( const std::string &file )
+  {
+    std::ifstream in( file );
+    bool loaded = false;
+    load( in, [ this, &file, &loaded ] () {
+        loaded = true;
+        if( journal_ )
+          journal_->recordLoad( file );
+      } );
+    if( loaded && journal_ )
+      restartJournal();
+  }
+
+  // load a PNG of a journal's checkpoint (not journaled again); as the undo
+  // history before a checkpoint is lost, the load cannot be undone either
+  void restore ( std::istream &in )
+  {
+    load( in, [] () {} );
+    if( !history_.recording() )
+      history_.clear();
+  }
+
+private:
+  // load a PNG, calling record once it is known to be loadable
+  template< class F >
+  void load ( std::istream &in, F &&record )
+  {
+    png::input png_in( in );
+
+    auto info = png_in.read_info();
+    const int width = info.image_width();
+    const int height = info.image_height();
+    const int channels = info.channels();
+    if( (channels != 3) && (channels != 4) )
+      return;
+
+    record();
+
+    step( [ this, &png_in, width, height, channels ] () {
+        std::unique_ptr< png::byte_t[] > band( new png::byte_t[ channels*width*Image::tileSize ] );
+        std::unique_ptr< png::byte_t[] > rgba( channels == 3 ? new png::byte_t[ 4*width*Image::tileSize ] : nullptr );
+        std::unique_ptr< png::byte_t *[] > rows( new png::byte_t *[ Image::tileSize ] );
+        for( int y = 0; y < Image::tileSize; ++y )
+          rows[ y ] = band.get() + channels*width*y;
+
+        eraseLayers();
+        for( int y = 0; y < std::min( height, image_.height() ); y += Image::tileSize )
+        {
+          const SDL_Rect rect{ 0, y, std::min( width, image_.width() ), std::min( int( Image::tileSize ), height - y ) };
+          png_in.read_rows( rows.get(), rect.h );
+          if( channels == 3 )
+          {
+            for( int k = 0; k < width*rect.h; ++k )
+            {
+              std::copy( band.get() + 3*k, band.get() + 3*k + 3, rgba.get() + 4*k );
+              rgba[ 4*k+3 ] = 255;
+            }
+          }
+          layers_.front().write( rect, (channels == 3 ? rgba : band).get(), 4*width );
+          damage( rect );
+          layers_.front().trim();
+          pyramid_.trim();
+        }
+      } );
+  }
+
+  // restart the journal from the current state (after a clear or load), so
+  // it does not grow forever: the drawings of the other sessions and the
+  // background of the one shown (unless blank) are checkpointed as images,
+  // followed by the view, the colour, the brush and the layer. The drawing
+  // layers are blank after a clear or load. Images are encoded on the
+  // journal's thread from detached copies; the drawings of other sessions are
+  // encoded only once after they were shown. A replay neither restores the
+  // undo history before the checkpoint nor continues the strokes in progress.
+  void restartJournal ()
+  {
+    if( journal_->restarting() )
+      return;
+
+    struct Drawing
+    {
+      std::string session;
+      std::shared_ptr< Image > image;   // to encode into png, if any
+      std::shared_ptr< std::string > png;
+    };
+    std::vector< Drawing > drawings;
+    for( std::pair< const std::string, Session > &session : sessions_ )
+    {
+      // an encoding failed before is retried
+      std::shared_ptr< std::string > &png = session.second.png;
+      if( png && !png->empty() )
+        drawings.push_back( Drawing{ session.first, nullptr, png } );
+      else
       {
-        ey += 2*dz;
-        y -= (dy < 0 ? -1 : 1);
+        png = std::make_shared< std::string >();
+        drawings.push_back( Drawing{ session.first, std::make_shared< Image >( session.second.image.detach() ), png } );
       }
     }
+    if( layers_.front().filled( 255, 255, 255 ) )
+      drawings.push_back( Drawing{ session_, nullptr, nullptr } );
+    else
+      drawings.push_back( Drawing{ session_, std::make_shared< Image >( layers_.front().detach() ), std::make_shared< std::string >() } );
+
+    journal_->restart( [ drawings = std::move( drawings ), x = x_, y = y_, zoom = zoom_, r = r_, g = g_, b = b_, brush = brush_, layer = layer_ ] ( Journal &journal ) {
+        for( const Drawing &drawing : drawings )
+        {
+          journal.recordOpen( drawing.session );
+          if( drawing.image )
+          {
+            std::ostringstream png;
+            save( *drawing.image, png );
+            *drawing.png = png.str();
+          }
+          if( drawing.png )
+            journal.recordImage( *drawing.png );
+        }
+        journal.recordView( x, y, zoom );
+        journal.recordColor( r, g, b );
+        journal.recordBrush( brush.radius, brush.hardness );
+        if( layer != 1 )
+          journal.recordLayer( layer );
+      } );
+  }
+
+public:
+
+  void save ( std::ostream &out )
+  {
+    apply();
+    save( image_, out );
+  }
+
+  // save the drawing of a session, which need not be shown; a session never
+  // opened is blank
+  void save ( std::ostream &out, const std::string &session )
+  {
+    const auto pos = sessions_.find( session );
+    if( session == session_ )
+      save( out );
+    else if( pos != sessions_.end() )
+    {
+      save( pos->second.image, out );
+      pos->second.image.pageOut();
+    }
+    else
+    {
+      Image blank( image_.width(), image_.height(), 255, 255, 255 );
+      save( blank, out );
+    }
+  }
+
+  void save ( const std::string &file )
+  {
+    std::ofstream out( file );
+    save( out );
+  }
+
+  static void save ( Image &image, const std::string &file )
+  {
+    std::ofstream out( file );
+    save( image, out );
+  }
+
+  // Flushable
+
+  void flush () override
+  {
+    Texture::flush();
+    apply();
+    if( prediction_ > 0.0f )
+      predict();
+    for( SDL_Rect &rect : dirty_ )
+    {
+      if( (rect.w <= 0) || (rect.h <= 0) )
+        continue;
+      upload( rect );
+      screen_->damage( texture_, rect );
+      rect = SDL_Rect{ 0, 0, 0, 0 };
+    }
+    trim();
+  }
+
+  // flood fill the region around (x, y) in the view with the current colour;
+  // the region is found in the flattened image (so outlines of the background
+  // bound it), but filled on the current drawing layer
+  void fill ( float x, float y )
+  {
+    if( journal_ )
+      journal_->recordFill( x, y );
+    const Stroke::Point p = toImage( x, y );
+    step( [ this, p ] () {
+        // fill a copy of the flattened image, sharing the tiles not filled
+        Image filled = image_;
+        const SDL_Rect rect = floodFill( filled, int( std::floor( p.x ) ), int( std::floor( p.y ) ), r_, g_, b_, fillTolerance );
+        // copy the pixels changed into the layer
+        const Image &image = image_;
+        const Uint8 color[ 4 ] = { r_, g_, b_, 255 };
+        for( int j = rect.y / Image::tileSize; j*Image::tileSize < rect.y + rect.h; ++j )
+        {
+          for( int i = rect.x / Image::tileSize; i*Image::tileSize < rect.x + rect.w; ++i )
+          {
+            const int k = j*image.tilesX() + i;
+            if( filled.tile( k ) == image.tile( k ) )
+              continue;
+            layer().modifyTiles( image.tileRect( k ), [ &image, &filled, &color ] ( std::uint8_t *dst, int pitch, const SDL_Rect &part ) {
+                const std::uint8_t *before = image.pixel( part.x, part.y ), *after = filled.pixel( part.x, part.y );
+                for( int y = 0; y < part.h; ++y, dst += pitch, before += Image::tilePitch, after += Image::tilePitch )
+                {
+                  for( int x = 0; x < 4*part.w; x += 4 )
+                  {
+                    if( std::memcmp( before + x, after + x, 4 ) != 0 )
+                      std::memcpy( dst + x, color, 4 );
+                  }
+                }
+              } );
+          }
+          filled.trim();
+          trimLayers();
+        }
+        damage( rect );
+      } );
+  }
+
+  // the next touch fills instead of drawing
+  void selectBucket () { bucket_ = true; }
+  bool bucket () const { return bucket_; }
+
+  static constexpr Uint8 fillTolerance = 48;
+
+  // Touchable
+
+  // every pointer (mouse or finger) draws its own stroke; the stamps of all
+  // strokes are rasterized in one pass per frame. If the canvas is zoomable,
+  // two fingers pan and zoom instead. Coordinates are those of the view.
+
+  bool down ( const Pointer &pointer, float x, float y )
+  {
+    // a new touch of a pointer no longer ignored (its release might not have
+    // been journaled)
+    ignored_.erase( std::remove( ignored_.begin(), ignored_.end(), pointer ), ignored_.end() );
+
+    if( bucket_ )
+    {
+      bucket_ = false;
+      ignored_.push_back( pointer );
+      fill( x, y );
+      return true;
+    }
+
+    if( journal_ )
+      journal_->recordDown( pointer, x, y );
+
+    if( !gesture_.empty() )
+    {
+      ignored_.push_back( pointer );
+      return false;
+    }
+    if( zoomable() && (strokes_.size() == 1) && (strokes_.front().second.count() <= gestureDelay) && (find( pointer ) == strokes_.end()) )
+    {
+      beginGesture( pointer, x, y );
+      return true;
+    }
+
+    Stroke &stroke = this->stroke( pointer );
+    stroke.begin( toImage( x, y ), painter( stroke ) );
+    return true;
+  }
+
+  bool up ( const Pointer &pointer, float x, float y )
+  {
+    if( ignore( pointer, true ) )
+      return false;
+
+    auto gesture = findGesture( pointer );
+    if( gesture != gesture_.end() )
+    {
+      if( journal_ )
+        journal_->recordUp( pointer, x, y );
+      // the other finger must be lifted before drawing again
+      gesture_.erase( gesture );
+      ignored_.push_back( gesture_.front().first );
+      gesture_.clear();
+      return true;
+    }
+
+    auto pos = find( pointer );
+    if( pos == strokes_.end() )
+      return false;
+    if( journal_ )
+      journal_->recordUp( pointer, x, y );
+    pos->second.end( toImage( x, y ), painter( pos->second ) );
+    strokes_.erase( pos );
+    if( strokes_.empty() )
+      endStep();
+    return true;
+  }
+
+  bool move ( const Pointer &pointer, float x, float y, float dx, float dy )
+  {
+    if( ignore( pointer, false ) )
+      return false;
+
+    if( journal_ )
+      journal_->recordMove( pointer, x, y, dx, dy );
+
+    auto gesture = findGesture( pointer );
+    if( gesture != gesture_.end() )
+    {
+      moveGesture( gesture, x, y );
+      return true;
+    }
+
+    // strokes might enter the canvas from a button
+    Stroke &stroke = this->stroke( pointer );
+    if( !stroke.active() )
+      stroke.begin( toImage( x - dx, y - dy ), painter( stroke ) );
+    stroke.extend( toImage( x, y ), painter( stroke ) );
     return true;
   }
 };
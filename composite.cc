@@ -0,0 +1,189 @@
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMPOSITE_X86 1
+#endif // #if defined(__x86_64__) || defined(__i386__)
+
+#include "composite.hh"
+
+
+// division by 255, rounded to nearest (exact for 0 <= x <= 255*255)
+static inline unsigned int div255 ( unsigned int x )
+{
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+
+// Scalar Kernel
+// -------------
+
+static void blendScalarRow ( std::uint8_t *dst, const std::uint8_t *coverage, int width, std::uint8_t r, std::uint8_t g, std::uint8_t b )
+{
+  for( int x = 0; x < width; ++x, dst += 4 )
+  {
+    const unsigned int a = coverage[ x ];
+    if( a == 0 )
+      continue;
+    dst[ 0 ] = div255( r*a + dst[ 0 ]*(255 - a) );
+    dst[ 1 ] = div255( g*a + dst[ 1 ]*(255 - a) );
+    dst[ 2 ] = div255( b*a + dst[ 2 ]*(255 - a) );
+    dst[ 3 ] = div255( 255*a + dst[ 3 ]*(255 - a) );
+  }
+}
+
+
+static void blendScalar ( std::uint8_t *dst, int dstPitch, const std::uint8_t *coverage, int coveragePitch,
+                          int width, int height, std::uint8_t r, std::uint8_t g, std::uint8_t b )
+{
+  for( int y = 0; y < height; ++y, dst += dstPitch, coverage += coveragePitch )
+    blendScalarRow( dst, coverage, width, r, g, b );
+}
+
+
+
+#ifdef COMPOSITE_X86
+
+// SSE2 Kernel
+// -----------
+
+// blend two pixels held in 16-bit lanes
+__attribute__(( target( "sse2" ) ))
+static inline __m128i blend16 ( __m128i dst, __m128i a, __m128i color )
+{
+  const __m128i x = _mm_add_epi16( _mm_add_epi16( _mm_mullo_epi16( color, a ), _mm_mullo_epi16( dst, _mm_sub_epi16( _mm_set1_epi16( 255 ), a ) ) ), _mm_set1_epi16( 128 ) );
+  return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) ), 8 );
+}
+
+
+__attribute__(( target( "sse2" ) ))
+static void blendSSE2 ( std::uint8_t *dst, int dstPitch, const std::uint8_t *coverage, int coveragePitch,
+                        int width, int height, std::uint8_t r, std::uint8_t g, std::uint8_t b )
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i color = _mm_set_epi16( 255, b, g, r, 255, b, g, r );
+
+  for( int y = 0; y < height; ++y, dst += dstPitch, coverage += coveragePitch )
+  {
+    int x = 0;
+    for( ; x + 4 <= width; x += 4 )
+    {
+      std::uint32_t c;
+      std::memcpy( &c, coverage + x, sizeof( c ) );
+      if( c == 0 )
+        continue;
+
+      // expand the coverage of 4 pixels to all 4 channels each
+      __m128i a = _mm_cvtsi32_si128( c );
+      a = _mm_unpacklo_epi8( a, a );
+      a = _mm_unpacklo_epi16( a, a );
+
+      __m128i *p = reinterpret_cast< __m128i * >( dst + 4*x );
+      const __m128i d = _mm_loadu_si128( p );
+      const __m128i lo = blend16( _mm_unpacklo_epi8( d, zero ), _mm_unpacklo_epi8( a, zero ), color );
+      const __m128i hi = blend16( _mm_unpackhi_epi8( d, zero ), _mm_unpackhi_epi8( a, zero ), color );
+      _mm_storeu_si128( p, _mm_packus_epi16( lo, hi ) );
+    }
+    blendScalarRow( dst + 4*x, coverage + x, width - x, r, g, b );
+  }
+}
+
+
+
+// AVX2 Kernel
+// -----------
+
+__attribute__(( target( "avx2" ) ))
+static inline __m256i blend16 ( __m256i dst, __m256i a, __m256i color )
+{
+  const __m256i x = _mm256_add_epi16( _mm256_add_epi16( _mm256_mullo_epi16( color, a ), _mm256_mullo_epi16( dst, _mm256_sub_epi16( _mm256_set1_epi16( 255 ), a ) ) ), _mm256_set1_epi16( 128 ) );
+  return _mm256_srli_epi16( _mm256_add_epi16( x, _mm256_srli_epi16( x, 8 ) ), 8 );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static void blendAVX2 ( std::uint8_t *dst, int dstPitch, const std::uint8_t *coverage, int coveragePitch,
+                        int width, int height, std::uint8_t r, std::uint8_t g, std::uint8_t b )
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i color = _mm256_set_epi16( 255, b, g, r, 255, b, g, r, 255, b, g, r, 255, b, g, r );
+
+  for( int y = 0; y < height; ++y, dst += dstPitch, coverage += coveragePitch )
+  {
+    int x = 0;
+    for( ; x + 8 <= width; x += 8 )
+    {
+      std::uint64_t c;
+      std::memcpy( &c, coverage + x, sizeof( c ) );
+      if( c == 0 )
+        continue;
+
+      // expand the coverage of 8 pixels to all 4 channels each; the 128-bit
+      // lanes hold pixels 0-3 and 4-7, matching the unpacking of dst below
+      __m128i a = _mm_loadl_epi64( reinterpret_cast< const __m128i * >( coverage + x ) );
+      a = _mm_unpacklo_epi8( a, a );
+      const __m256i aa = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_unpacklo_epi16( a, a ) ), _mm_unpackhi_epi16( a, a ), 1 );
+
+      __m256i *p = reinterpret_cast< __m256i * >( dst + 4*x );
+      const __m256i d = _mm256_loadu_si256( p );
+      const __m256i lo = blend16( _mm256_unpacklo_epi8( d, zero ), _mm256_unpacklo_epi8( aa, zero ), color );
+      const __m256i hi = blend16( _mm256_unpackhi_epi8( d, zero ), _mm256_unpackhi_epi8( aa, zero ), color );
+      _mm256_storeu_si256( p, _mm256_packus_epi16( lo, hi ) );
+    }
+    blendScalarRow( dst + 4*x, coverage + x, width - x, r, g, b );
+  }
+}
+
+#endif // #ifdef COMPOSITE_X86
+
+
+
+// Implementation of Auxiliary Functions
+// -------------------------------------
+
+const std::vector< CompositeKernel > &compositeKernels ()
+{
+  static const std::vector< CompositeKernel > kernels = [] () {
+      std::vector< CompositeKernel > kernels;
+      kernels.push_back( CompositeKernel{ "scalar", blendScalar } );
+#ifdef COMPOSITE_X86
+      __builtin_cpu_init();
+      if( __builtin_cpu_supports( "sse2" ) )
+        kernels.push_back( CompositeKernel{ "sse2", blendSSE2 } );
+      if( __builtin_cpu_supports( "avx2" ) )
+        kernels.push_back( CompositeKernel{ "avx2", blendAVX2 } );
+#endif // #ifdef COMPOSITE_X86
+      return kernels;
+    } ();
+  return kernels;
+}
+
+
+const CompositeKernel &compositeKernel ()
+{
+  static const CompositeKernel &kernel = compositeKernels().back();
+  return kernel;
+}
+
+
+void compositeOver ( std::uint8_t *dst, int dstPitch, const std::uint8_t *src, int srcPitch, int width, int height )
+{
+  for( int y = 0; y < height; ++y, dst += dstPitch, src += srcPitch )
+  {
+    for( int x = 0; x < 4*width; x += 4 )
+    {
+      // layers are mostly either transparent or opaque
+      const unsigned int a = src[ x+3 ];
+      if( a == 0 )
+        continue;
+      if( a == 255 )
+      {
+        std::memcpy( dst + x, src + x, 4 );
+        continue;
+      }
+      for( int c = 0; c < 4; ++c )
+        dst[ x+c ] = std::uint8_t( src[ x+c ] + div255( dst[ x+c ]*(255 - a) ) );
+    }
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef COMPOSITE_HH
+#define COMPOSITE_HH
+
+#include <cstdint>
+
+#include <vector>
+
+
+// CompositeKernel
+// ---------------
+//
+// Blends a colour with 8-bit coverage into an RGBA buffer (byte order R, G,
+// B, A), i.e., dst = color*a + dst*(1-a) for all channels with the colour's
+// alpha being 255. All kernels round identically, so their results are
+// bit-exact.
+
+struct CompositeKernel
+{
+  typedef void (*Blend) ( std::uint8_t *dst, int dstPitch, const std::uint8_t *coverage, int coveragePitch,
+                          int width, int height, std::uint8_t r, std::uint8_t g, std::uint8_t b );
+
+  const char *name;
+  Blend blend;
+};
+
+
+
+// Auxiliary Functions
+// -------------------
+
+// all kernels supported by the CPU we are running on, the fastest one last
+const std::vector< CompositeKernel > &compositeKernels ();
+
+// the fastest kernel supported by the CPU we are running on
+const CompositeKernel &compositeKernel ();
+
+// composite premultiplied RGBA src over dst; painting with a kernel onto a
+// transparent image yields premultiplied pixels
+void compositeOver ( std::uint8_t *dst, int dstPitch, const std::uint8_t *src, int srcPitch, int width, int height );
+
+#endif // #ifndef COMPOSITE_HH
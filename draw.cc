@@ -1,13 +1,31 @@
-#include <future>
+#include <cstdlib>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
 #include <regex>
+#include <set>
+#include <string>
+
+#include <experimental/filesystem>
 
+#include "atlas.hh"
+#include "buttons/bucket.hh"
 #include "buttons/clear.hh"
 #include "buttons/color.hh"
+#include "buttons/redo.hh"
+#include "buttons/size.hh"
 #include "buttons/snapshot.hh"
+#include "buttons/undo.hh"
 #include "canvas.hh"
 #include "cursor.hh"
+#include "evdev.hh"
+#include "journal.hh"
 #include "screen.hh"
 #include "snapshots.hh"
+#include "tasks.hh"
+#include "trace.hh"
 #include "webserver.hh"
 
 extern const char arrow_cursor[];
@@ -99,55 +117,223 @@ public:
 
 
 
+// TaskContentRequestHandler
+// -------------------------
+//
+// Content produced by a task in the event loop; the task is cancelled if the
+// task queue is full.
+
+class TaskContentRequestHandler
+  : public httpd::RequestHandler
+{
+  std::string contentType_;
+  TaskResult< std::string > content_;
+
+public:
+  explicit TaskContentRequestHandler ( std::string contentType )
+    : contentType_( std::move( contentType ) )
+  {}
+
+  TaskPromise< std::string > promise () { return content_.promise(); }
+
+  bool operator() ( httpd::Connection connection, const char *uploadData, size_t *uploadDataSize ) override
+  {
+    std::string content;
+    if( !content_.wait( content ) )
+      return connection.queue( httpd::StatusCode::ServiceUnavailable, httpd::Response() );
+    return connection.queue( httpd::StatusCode::Ok, httpd::Response::makeContentResponse( contentType_, content ) );
+  }
+};
+
+
+
 // CanvasResource
 // --------------
+//
+// The drawing shown or, if a session name is given, that of the session (blank
+// if it was never opened).
 
 class CanvasResource
   : public MicroWebServer::Resource
 {
   Screen &screen_;
   Canvas &canvas_;
+  std::string session_;
+
+public:
+  explicit CanvasResource ( Screen &screen, Canvas &canvas, std::string session = std::string() )
+    : screen_( screen ), canvas_( canvas ), session_( std::move( session ) )
+  {}
 
-  class GetRequestHandler
-    : public httpd::RequestHandler
+  std::unique_ptr< httpd::RequestHandler > getGetHandler ( httpd::Connection connection ) const override
   {
-    std::future< std::string > content_;
+    // encoding the canvas is expensive; concurrent requests share one encoding
+    // (the task must not refer to this resource, which is created per request
+    // for sessions and may be gone before the task is run)
+    auto handler = std::make_unique< TaskContentRequestHandler >( "image/png" );
+    const std::size_t key = std::hash< std::string >()( "canvas/" + session_ ) | 1;
+    screen_.pushTask( makeSharedTask( handler->promise(), [ canvas = &canvas_, session = session_ ] () {
+        std::ostringstream content;
+        if( session.empty() )
+          canvas->save( content );
+        else
+          canvas->save( content, session );
+        return content.str();
+      } ), key );
+    return std::move( handler );
+  }
 
-  public:
-    GetRequestHandler ( std::future< std::string > content )
-      : content_( std::move( content ) )
-    {}
+  std::unique_ptr< httpd::RequestHandler > getHeadHandler ( httpd::Connection connection ) const override
+  {
+    return httpd::makeContentRequestHandler( "image/png" );
+  }
+};
 
-    bool operator() ( httpd::Connection connection, const char *uploadData, size_t *uploadDataSize ) override
-    {
-      content_.wait();
-      return connection.queue( httpd::StatusCode::Ok, httpd::Response::makeContentResponse( "image/png", content_.get() ) );
-    }
-  };
+
+
+// SessionsResource
+// ----------------
+
+class SessionsResource
+  : public MicroWebServer::Resource
+{
+  const std::set< std::string > &sessions_;
+  Screen &screen_;
+  Canvas &canvas_;
+  std::regex pattern_;
 
 public:
-  explicit CanvasResource ( Screen &screen, Canvas &canvas )
+  explicit SessionsResource ( const std::set< std::string > &sessions, Screen &screen, Canvas &canvas )
+    : sessions_( sessions ), screen_( screen ), canvas_( canvas ),
+      pattern_( "/([A-Za-z0-9_-]+)[.]png" )
+  {}
+
+  std::shared_ptr< Resource > operator[] ( std::string url ) override
+  {
+    std::smatch subMatch;
+    if( !std::regex_match( url, subMatch, pattern_ ) || !sessions_.count( subMatch[ 1 ].str() ) )
+      return nullptr;
+
+    return std::make_shared< CanvasResource >( screen_, canvas_, subMatch[ 1 ].str() );
+  }
+};
+
+
+
+// OpenResource
+// ------------
+
+class OpenResource
+  : public MicroWebServer::Resource
+{
+  const std::set< std::string > &sessions_;
+  Screen &screen_;
+  Canvas &canvas_;
+
+public:
+  explicit OpenResource ( const std::set< std::string > &sessions, Screen &screen, Canvas &canvas )
+    : sessions_( sessions ), screen_( screen ), canvas_( canvas )
+  {}
+
+  std::unique_ptr< httpd::RequestHandler > getGetHandler ( httpd::Connection connection ) const override
+  {
+    MicroWebServer::Arguments arguments( connection );
+    const std::string session = arguments[ "name" ];
+    if( !sessions_.count( session ) )
+      return httpd::makeNotFoundRequestHandler();
+
+    screen_.pushTask( [ this, session ] () -> bool {
+        canvas_.open( session );
+        return true;
+      } );
+
+    std::ostringstream content;
+    content << "<html>" << std::endl;
+    content << "<body>" << std::endl;
+    content << "<div style=\"width: 100%; background-color: #ff8000;\">" << std::endl;
+    content << "<h1 style=\"margin: 5px;\">Canvas opened: " << session << "</h1>" << std::endl;
+    content << "</div>" << std::endl;
+    content << "<img src=\"/canvas/" + session + ".png\" style=\"width: 100%;\"></img>" << std::endl;
+    content << "</body>" << std::endl;
+    content << "</html>" << std::endl;
+    return httpd::makeContentRequestHandler( "text/html", content.str() );
+  }
+};
+
+
+
+// LayerResource
+// -------------
+//
+// Selects the drawing layer painted on (1 to Canvas::maxLayers), e.g.,
+// /layer?number=2 to draw below layer 3.
+
+class LayerResource
+  : public MicroWebServer::Resource
+{
+  Screen &screen_;
+  Canvas &canvas_;
+
+public:
+  LayerResource ( Screen &screen, Canvas &canvas )
     : screen_( screen ), canvas_( canvas )
   {}
 
   std::unique_ptr< httpd::RequestHandler > getGetHandler ( httpd::Connection connection ) const override
   {
-    std::promise< std::string > promise;
+    MicroWebServer::Arguments arguments( connection );
+    const std::string number = arguments[ "number" ];
+    char *end = nullptr;
+    const long layer = std::strtol( number.c_str(), &end, 10 );
+    if( number.empty() || *end || (layer < 1) || (layer > Canvas::maxLayers) )
+      return httpd::makeNotFoundRequestHandler();
 
-    std::future< std::string > future = promise.get_future();
-    screen_.pushLambdaEvent( [ this, p( std::move( promise ) ) ] () mutable -> bool {
-        std::ostringstream content;
-        canvas_.save( content );
-        p.set_value( content.str() );
+    screen_.pushTask( [ this, layer ] () -> bool {
+        canvas_.selectLayer( int( layer ) );
         return false;
       } );
 
-    return std::make_unique< GetRequestHandler >( std::move( future ) );
+    std::ostringstream content;
+    content << "<html>" << std::endl;
+    content << "<body>" << std::endl;
+    content << "<div style=\"width: 100%; background-color: #ff8000;\">" << std::endl;
+    content << "<h1 style=\"margin: 5px;\">Layer selected: " << layer << "</h1>" << std::endl;
+    content << "</div>" << std::endl;
+    content << "</body>" << std::endl;
+    content << "</html>" << std::endl;
+    return httpd::makeContentRequestHandler( "text/html", content.str() );
+  }
+};
+
+
+
+// StatisticsResource
+// ------------------
+
+class StatisticsResource
+  : public MicroWebServer::Resource
+{
+  Screen &screen_;
+
+public:
+  explicit StatisticsResource ( Screen &screen )
+    : screen_( screen )
+  {}
+
+  std::unique_ptr< httpd::RequestHandler > getGetHandler ( httpd::Connection connection ) const override
+  {
+    auto handler = std::make_unique< TaskContentRequestHandler >( "text/plain" );
+    screen_.pushTask( makeSharedTask( handler->promise(), [ this ] () {
+        std::ostringstream content;
+        content << screen_.statistics() << screen_.loopStatistics();
+        return content.str();
+      } ), std::hash< std::string >()( "statistics" ) | 1, Task::high );
+    return std::move( handler );
   }
 
   std::unique_ptr< httpd::RequestHandler > getHeadHandler ( httpd::Connection connection ) const override
   {
-    return httpd::makeContentRequestHandler( "image/png" );
+    return httpd::makeContentRequestHandler( "text/plain" );
   }
 };
 
@@ -178,9 +364,8 @@ public:
     if( !snapShots_.exists( timeStamp ) )
       return httpd::makeNotFoundRequestHandler();
 
-    screen_.pushLambdaEvent( [ this, timeStamp ] () -> bool {
-        //canvas.load( snapShots.toFileName( timeStamp ) );
-        canvas_.blit( 0, 0, Texture( screen_, snapShots_.toFileName( timeStamp ) ) );
+    screen_.pushTask( [ this, timeStamp ] () -> bool {
+        canvas_.load( snapShots_.toFileName( timeStamp ) );
         return true;
       } );
 
@@ -204,6 +389,14 @@ public:
 
 int main ( int argc, char **argv )
 {
+  // --headless draws without a display, like KIDZ_DRAW_HEADLESS=WxH (e.g., to
+  // profile replaying a journal)
+  for( int i = 1; i < argc; ++i )
+  {
+    if( std::string( argv[ i ] ) == "--headless" )
+      setenv( "KIDZ_DRAW_HEADLESS", "", 0 );
+  }
+
   Screen screen;
   SnapShots snapShots;
 
@@ -212,30 +405,148 @@ int main ( int argc, char **argv )
   Cursor cursor( cursorIn );
   setCursor( cursor );
 
-  Canvas canvas( screen, 1, 0, 15, 9 );
+  // which rasterizer is faster depends on the device (see bench-paint);
+  // canvases larger than the view (--size=WxH) are panned and zoomed with
+  // two fingers. The journal is replayed in view coordinates, so the size
+  // must not change between runs (nor the display, which determines the
+  // size of the view). Each --session=<name> adds a canvas session, which
+  // can be opened and downloaded through the web server. --low-latency
+  // presents input at once and draws predicted ink ahead of the strokes;
+  // compare the latencies in statistics.txt. --touch-device=<path> reads
+  // the touch screen's evdev device in a thread of its own instead of
+  // taking touches from SDL. --trace=<file> records all input for
+  // bench-trace. --hud shows performance numbers on screen (F1 toggles).
+  Canvas::Rasterizer rasterizer = Canvas::Rasterizer::stamps;
+  const int columns = screen.columns(), rows = screen.rows();
+  int width = (columns-2)*screen.tileSize(), height = rows*screen.tileSize();
+  std::set< std::string > sessions = { "default" };
+  bool lowLatency = false;
+  std::unique_ptr< TouchReader > touchReader;
+  std::unique_ptr< Trace > trace;
+  for( int i = 1; i < argc; ++i )
+  {
+    const std::string option( argv[ i ] );
+    std::smatch size, session, device, file;
+    if( option == "--headless" )
+      continue;
+    else if( option == "--low-latency" )
+      lowLatency = true;
+    else if( option == "--hud" )
+      screen.hud = true;
+    else if( option == "--capsules" )
+      rasterizer = Canvas::Rasterizer::capsules;
+    else if( option == "--stamps" )
+      rasterizer = Canvas::Rasterizer::stamps;
+    else if( std::regex_match( option, size, std::regex( "--size=([0-9]+)x([0-9]+)" ) ) )
+    {
+      // strtol saturates, so overlong numbers are out of range as well
+      const long w = std::strtol( size[ 1 ].str().c_str(), nullptr, 10 ), h = std::strtol( size[ 2 ].str().c_str(), nullptr, 10 );
+      if( (w <= Canvas::maxSize) && (h <= Canvas::maxSize) )
+      {
+        width = std::max( int( w ), width );
+        height = std::max( int( h ), height );
+      }
+      else
+        std::cerr << "Ignoring option '" << argv[ i ] << "' (at most " << Canvas::maxSize << " pixels each)" << std::endl;
+    }
+    else if( std::regex_match( option, session, std::regex( "--session=([A-Za-z0-9_-]+)" ) ) )
+      sessions.insert( session[ 1 ].str() );
+    else if( std::regex_match( option, device, std::regex( "--touch-device=(.+)" ) ) )
+    {
+      try
+      {
+        touchReader.reset( new TouchReader( device[ 1 ].str() ) );
+      }
+      catch( const std::exception &e )
+      {
+        std::cerr << e.what() << ", using SDL's touch events" << std::endl;
+      }
+    }
+    else if( std::regex_match( option, file, std::regex( "--trace=(.+)" ) ) )
+    {
+      try
+      {
+        trace.reset( new Trace( file[ 1 ].str(), screen.outputWidth(), screen.outputHeight() ) );
+      }
+      catch( const std::exception &e )
+      {
+        std::cerr << e.what() << std::endl;
+      }
+    }
+    else
+      std::cerr << "Ignoring unknown option '" << argv[ i ] << "'" << std::endl;
+  }
 
-  ColorButton black( screen, 0, 0, canvas, 0, 0, 0 );
-  ColorButton violet( screen, 0, 1, canvas, 160, 0, 192 );
-  ColorButton blue( screen, 0, 2, canvas, 64, 64, 255 );
-  ColorButton green( screen, 0, 3, canvas, 0, 128, 32 );
-  ColorButton yellow( screen, 0, 4, canvas, 255, 255, 0 );
-  ColorButton orange( screen, 0, 5, canvas, 255, 128, 0 );
-  ColorButton red( screen, 0, 6, canvas, 255, 0, 0 );
+  Canvas canvas( screen, 1, 0, columns-2, rows, width, height );
+  canvas.setRasterizer( rasterizer );
+  if( lowLatency )
+  {
+    screen.lowLatency = true;
+    canvas.setPrediction( 1.0f );
+  }
 
-  SnapShotButton snapShot( screen, 0, 7, canvas, snapShots );
-  ClearButton clear( screen, 0, 8, canvas );
+  // restore the canvas from the journal, cutting off a truncated record
+  const std::string journalFile = "kidz-draw.journal";
+  if( std::ifstream in{ journalFile, std::ios::binary } )
+  {
+    try
+    {
+      const ReplayStatistics statistics = replay( in, canvas );
+      std::cout << "Journal replayed:" << std::endl << statistics;
+      std::experimental::filesystem::resize_file( journalFile, statistics.valid );
+    }
+    catch( const std::exception &e )
+    {
+      std::cerr << "Unable to replay journal: " << e.what() << std::endl;
+      std::experimental::filesystem::rename( journalFile, journalFile + ".broken" );
+    }
+  }
+  Journal journal( journalFile );
+  canvas.setJournal( &journal );
+
+  // all button art shares one texture, a column of cells per column of buttons
+  Atlas atlas( screen, 2, 9 );
+
+  ColorButton black( screen, atlas, 0, 0, canvas, 0, 0, 0 );
+  ColorButton violet( screen, atlas, 0, 1, canvas, 160, 0, 192 );
+  ColorButton blue( screen, atlas, 0, 2, canvas, 64, 64, 255 );
+  ColorButton green( screen, atlas, 0, 3, canvas, 0, 128, 32 );
+  ColorButton yellow( screen, atlas, 0, 4, canvas, 255, 255, 0 );
+  ColorButton orange( screen, atlas, 0, 5, canvas, 255, 128, 0 );
+  ColorButton red( screen, atlas, 0, 6, canvas, 255, 0, 0 );
+
+  SnapShotButton snapShot( screen, atlas, 0, 7, canvas, snapShots );
+  ClearButton clear( screen, atlas, 0, 8, canvas );
+
+  UndoButton undo( screen, atlas, columns-1, 0, canvas );
+  RedoButton redo( screen, atlas, columns-1, 1, canvas );
+  BucketButton bucket( screen, atlas, columns-1, 2, canvas );
+
+  // brushes keep their size relative to the buttons (designed for 120px tiles)
+  const float scale = float( screen.tileSize() ) / 120.0f;
+  SizeButton small( screen, atlas, columns-1, 3, canvas, 3.0f*scale );
+  SizeButton medium( screen, atlas, columns-1, 4, canvas, 6.0f*scale );
+  SizeButton large( screen, atlas, columns-1, 5, canvas, 12.0f*scale );
+  SizeButton soft( screen, atlas, columns-1, 6, canvas, 24.0f*scale, 0.0f );
 
   auto webRoot = std::make_shared< MicroWebServer::MapResource >();
 
   webRoot->add( "/", std::make_shared< MicroWebServer::RedirectResource >( "gallery.html" ) );
   webRoot->add( "/gallery.html", std::make_shared< GalleryResource >( snapShots ) );
   webRoot->add( "/canvas.png", std::make_shared< CanvasResource >( screen, canvas ) );
+  webRoot->add( "/canvas", std::make_shared< SessionsResource >( sessions, screen, canvas ) );
+  webRoot->add( "/open", std::make_shared< OpenResource >( sessions, screen, canvas ) );
+  webRoot->add( "/layer", std::make_shared< LayerResource >( screen, canvas ) );
   webRoot->add( "/snapshots", std::make_shared< SnapShotsResource >( snapShots ) );
   webRoot->add( "/edit", std::make_shared< EditResource >( snapShots, screen, canvas ) );
+  webRoot->add( "/statistics.txt", std::make_shared< StatisticsResource >( screen ) );
   webRoot->add( "/palette.png", std::make_shared< MicroWebServer::StaticDataResource >( palette_data, palette_size, "image/png" ) );
 
   MicroWebServer::WebServer webServer( 1234, webRoot );
 
+  if( touchReader )
+    screen.setTouchReader( *touchReader );
+  screen.setTrace( trace.get() );
   screen.eventLoop();
 
   return 0;
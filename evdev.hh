@@ -0,0 +1,301 @@
+#ifndef EVDEV_HH
+#define EVDEV_HH
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <SDL.h>
+
+#include "ring.hh"
+
+
+// TouchSample
+// -----------
+
+struct TouchSample
+{
+  enum Type : std::uint8_t { down, move, up };
+
+  Type type;
+  int slot;               // identifies the finger while it touches
+  float x, y, dx, dy;     // normalized to [0, 1], like SDL's touch events
+  std::uint64_t time;     // time of the report (in microseconds)
+  Uint32 ticks;           // SDL_GetTicks() when the report was read
+};
+
+
+
+// TouchReader
+// -----------
+//
+// Reads a multi-touch device (protocol B, e.g., /dev/input/eventN) in a thread
+// of its own and queues every report as samples, without any coalescing. The
+// samples are handed over through a lock-free ring buffer; the consumer is
+// notified only when the buffer was drained before, so a busy device costs one
+// notification per frame, not per report.
+
+class TouchReader
+{
+public:
+  struct Range
+  {
+    int min, max;
+  };
+
+  static constexpr int maxSlots = 16;
+
+  // SDL touch id of the samples (see Screen::setTouchReader)
+  static constexpr SDL_TouchID touchId = -2;
+
+  explicit TouchReader ( const std::string &device )
+    : TouchReader( open( device ) )
+  {}
+
+  // read from an open file descriptor, taking ownership of it
+  TouchReader ( int fd, Range x, Range y )
+    : fd_( fd ), x_( x ), y_( y )
+  {
+    if( pipe( stop_ ) != 0 )
+    {
+      close( fd_ );
+      throw std::runtime_error( "Unable to create pipe" );
+    }
+  }
+
+  TouchReader ( const TouchReader & ) = delete;
+  TouchReader &operator= ( const TouchReader & ) = delete;
+
+  ~TouchReader ()
+  {
+    if( thread_.joinable() )
+    {
+      const char stop = 0;
+      if( write( stop_[ 1 ], &stop, 1 ) == 1 )
+        thread_.join();
+      else
+        thread_.detach();
+    }
+    close( stop_[ 0 ] );
+    close( stop_[ 1 ] );
+    close( fd_ );
+  }
+
+  // the ring buffer is aligned to cache lines, which the global operator new
+  // does not honour before C++17
+  static void *operator new ( std::size_t size )
+  {
+    void *p = nullptr;
+    if( posix_memalign( &p, alignof( TouchReader ), size ) != 0 )
+      throw std::bad_alloc();
+    return p;
+  }
+
+  static void operator delete ( void *p ) { std::free( p ); }
+
+  // start reading; notify is called from the reader thread when samples are
+  // available after drain() has emptied the buffer
+  void start ( std::function< void () > notify )
+  {
+    notify_ = std::move( notify );
+    thread_ = std::thread( [ this ] () { run(); } );
+  }
+
+  // consume all samples queued; call from one thread only
+  template< class F >
+  void drain ( F &&f )
+  {
+    // an exchange, so the flag is cleared before the buffer is looked at (see
+    // TaskQueue::drain)
+    notified_.exchange( false, std::memory_order_seq_cst );
+    TouchSample sample;
+    while( samples_.pop( sample ) )
+      f( sample );
+  }
+
+  // number of samples lost, because the consumer did not keep up
+  std::size_t dropped () const { return dropped_.load( std::memory_order_relaxed ); }
+
+private:
+  struct Slot
+  {
+    bool down = false;
+    int id = -1;            // tracking id of the contact
+    int pending = -1;       // type of sample to emit with the next report
+    bool active = false;    // has the consumer seen the contact go down?
+    bool replaced = false;  // emit an up for the previous contact first
+    int x = 0, y = 0;
+    float lastX = 0.0f, lastY = 0.0f;
+  };
+
+  explicit TouchReader ( int fd )
+    : TouchReader( fd, range( fd, ABS_MT_POSITION_X ), range( fd, ABS_MT_POSITION_Y ) )
+  {}
+
+  static int open ( const std::string &device )
+  {
+    const int fd = ::open( device.c_str(), O_RDONLY | O_CLOEXEC );
+    if( fd < 0 )
+      throw std::runtime_error( "Unable to open touch device '" + device + "'" );
+    // report times on the same clock as SDL's performance counter
+    int clock = CLOCK_MONOTONIC;
+    ioctl( fd, EVIOCSCLOCKID, &clock );
+    return fd;
+  }
+
+  static Range range ( int fd, int axis )
+  {
+    input_absinfo info;
+    if( ioctl( fd, EVIOCGABS( axis ), &info ) != 0 )
+    {
+      close( fd );
+      throw std::runtime_error( "Device does not report multi-touch positions" );
+    }
+    return Range{ info.minimum, info.maximum };
+  }
+
+  static float normalize ( int value, Range range )
+  {
+    return (range.max > range.min ? float( value - range.min ) / float( range.max - range.min ) : 0.0f);
+  }
+
+  void emit ( const input_event &event )
+  {
+    const std::uint64_t time = std::uint64_t( event.time.tv_sec ) * 1000000u + std::uint64_t( event.time.tv_usec );
+    const Uint32 ticks = SDL_GetTicks();
+    bool queued = false;
+    for( int k = 0; k < maxSlots; ++k )
+    {
+      Slot &slot = slots_[ k ];
+      if( slot.pending < 0 )
+        continue;
+
+      if( slot.replaced )
+        queued |= push( TouchSample{ TouchSample::up, k, slot.lastX, slot.lastY, 0.0f, 0.0f, time, ticks } );
+      slot.replaced = false;
+
+      TouchSample sample{ TouchSample::Type( slot.pending ), k, normalize( slot.x, x_ ), normalize( slot.y, y_ ), 0.0f, 0.0f, time, ticks };
+      if( sample.type == TouchSample::move )
+      {
+        sample.dx = sample.x - slot.lastX;
+        sample.dy = sample.y - slot.lastY;
+      }
+      slot.lastX = sample.x;
+      slot.lastY = sample.y;
+      slot.active = (sample.type != TouchSample::up);
+      slot.pending = -1;
+
+      queued |= push( sample );
+    }
+    if( queued && !notified_.exchange( true, std::memory_order_seq_cst ) && notify_ )
+      notify_();
+  }
+
+  // queue a sample, counting it as dropped if the buffer is full
+  bool push ( const TouchSample &sample )
+  {
+    if( samples_.push( sample ) )
+      return true;
+    dropped_.fetch_add( 1, std::memory_order_relaxed );
+    return false;
+  }
+
+  void handle ( const input_event &event )
+  {
+    // after an overflow of the kernel's buffer, skip to the next report
+    if( (event.type == EV_SYN) && (event.code == SYN_DROPPED) )
+    {
+      synchronizing_ = true;
+      return;
+    }
+    if( (event.type == EV_SYN) && (event.code == SYN_REPORT) )
+    {
+      if( !synchronizing_ )
+        emit( event );
+      synchronizing_ = false;
+      return;
+    }
+    if( synchronizing_ || (event.type != EV_ABS) )
+      return;
+
+    if( event.code == ABS_MT_SLOT )
+    {
+      slot_ = ((event.value >= 0) && (event.value < maxSlots) ? event.value : -1);
+      return;
+    }
+    if( slot_ < 0 )
+      return;
+
+    Slot &slot = slots_[ slot_ ];
+    switch( event.code )
+    {
+    case ABS_MT_TRACKING_ID:
+      // a new contact may take over a slot without the old one being lifted
+      // in between; the old one is lifted first then
+      if( (event.value >= 0) && (!slot.down || (event.value != slot.id)) )
+      {
+        slot.replaced = slot.active;
+        slot.pending = TouchSample::down;
+      }
+      else if( (event.value < 0) && slot.down )
+        slot.pending = TouchSample::up;
+      slot.down = (event.value >= 0);
+      slot.id = event.value;
+      break;
+
+    case ABS_MT_POSITION_X:
+    case ABS_MT_POSITION_Y:
+      (event.code == ABS_MT_POSITION_X ? slot.x : slot.y) = event.value;
+      if( slot.down && (slot.pending < 0) )
+        slot.pending = TouchSample::move;
+      break;
+    }
+  }
+
+  void run ()
+  {
+    std::array< input_event, 64 > events;
+    pollfd fds[ 2 ] = { { fd_, POLLIN, 0 }, { stop_[ 0 ], POLLIN, 0 } };
+    while( poll( fds, 2, -1 ) >= 0 )
+    {
+      if( fds[ 1 ].revents != 0 )
+        return;
+      const ssize_t size = read( fd_, events.data(), sizeof( events ) );
+      if( size <= 0 )
+        return;
+      for( std::size_t k = 0; k < std::size_t( size ) / sizeof( input_event ); ++k )
+        handle( events[ k ] );
+    }
+  }
+
+  int fd_;
+  int stop_[ 2 ];
+  Range x_, y_;
+
+  // accessed by the reader thread only
+  std::array< Slot, maxSlots > slots_;
+  int slot_ = 0;
+  bool synchronizing_ = false;
+
+  RingBuffer< TouchSample, 4096 > samples_;
+  std::atomic< bool > notified_{ false };
+  std::atomic< std::size_t > dropped_{ 0 };
+  std::function< void () > notify_;
+  std::thread thread_;
+};
+
+#endif // #ifndef EVDEV_HH
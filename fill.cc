@@ -0,0 +1,287 @@
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILL_X86 1
+#endif // #if defined(__x86_64__) || defined(__i386__)
+
+#include "fill.hh"
+
+
+// Scalar Kernel
+// -------------
+
+static inline bool inside ( std::uint32_t pixel, const SpanKernel::Match &match )
+{
+  if( pixel == match.color )
+    return false;
+  for( int shift = 0; shift < 32; shift += 8 )
+  {
+    const int a = (pixel >> shift) & 0xff, b = (match.target >> shift) & 0xff;
+    if( std::abs( a - b ) > match.tolerance )
+      return false;
+  }
+  return true;
+}
+
+
+static int findScalar ( const std::uint32_t *row, int begin, int end, const SpanKernel::Match &match, bool in )
+{
+  for( ; begin < end; ++begin )
+  {
+    if( inside( row[ begin ], match ) == in )
+      return begin;
+  }
+  return end;
+}
+
+
+static int findBackScalar ( const std::uint32_t *row, int begin, int end, const SpanKernel::Match &match, bool in )
+{
+  for( --end; end >= begin; --end )
+  {
+    if( inside( row[ end ], match ) == in )
+      return end;
+  }
+  return begin-1;
+}
+
+
+
+#ifdef FILL_X86
+
+// SSE2 Kernel
+// -----------
+
+// bit k is set if pixel k lies inside
+__attribute__(( target( "sse2" ) ))
+static inline int inside4 ( __m128i p, __m128i target, __m128i color, __m128i tolerance )
+{
+  const __m128i difference = _mm_or_si128( _mm_subs_epu8( p, target ), _mm_subs_epu8( target, p ) );
+  const __m128i near = _mm_cmpeq_epi32( _mm_subs_epu8( difference, tolerance ), _mm_setzero_si128() );
+  const __m128i in = _mm_andnot_si128( _mm_cmpeq_epi32( p, color ), near );
+  return _mm_movemask_ps( _mm_castsi128_ps( in ) );
+}
+
+
+__attribute__(( target( "sse2" ) ))
+static int findSSE2 ( const std::uint32_t *row, int begin, int end, const SpanKernel::Match &match, bool in )
+{
+  const __m128i target = _mm_set1_epi32( match.target ), color = _mm_set1_epi32( match.color );
+  const __m128i tolerance = _mm_set1_epi8( match.tolerance );
+  const int flip = (in ? 0 : 0xf);
+  for( ; begin + 4 <= end; begin += 4 )
+  {
+    const int bits = inside4( _mm_loadu_si128( reinterpret_cast< const __m128i * >( row + begin ) ), target, color, tolerance ) ^ flip;
+    if( bits )
+      return begin + __builtin_ctz( bits );
+  }
+  return findScalar( row, begin, end, match, in );
+}
+
+
+__attribute__(( target( "sse2" ) ))
+static int findBackSSE2 ( const std::uint32_t *row, int begin, int end, const SpanKernel::Match &match, bool in )
+{
+  const __m128i target = _mm_set1_epi32( match.target ), color = _mm_set1_epi32( match.color );
+  const __m128i tolerance = _mm_set1_epi8( match.tolerance );
+  const int flip = (in ? 0 : 0xf);
+  for( ; end - 4 >= begin; end -= 4 )
+  {
+    const int bits = inside4( _mm_loadu_si128( reinterpret_cast< const __m128i * >( row + end - 4 ) ), target, color, tolerance ) ^ flip;
+    if( bits )
+      return end - 4 + (31 - __builtin_clz( bits ));
+  }
+  return findBackScalar( row, begin, end, match, in );
+}
+
+
+
+// AVX2 Kernel
+// -----------
+
+__attribute__(( target( "avx2" ) ))
+static inline int inside8 ( __m256i p, __m256i target, __m256i color, __m256i tolerance )
+{
+  const __m256i difference = _mm256_or_si256( _mm256_subs_epu8( p, target ), _mm256_subs_epu8( target, p ) );
+  const __m256i near = _mm256_cmpeq_epi32( _mm256_subs_epu8( difference, tolerance ), _mm256_setzero_si256() );
+  const __m256i in = _mm256_andnot_si256( _mm256_cmpeq_epi32( p, color ), near );
+  return _mm256_movemask_ps( _mm256_castsi256_ps( in ) );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static int findAVX2 ( const std::uint32_t *row, int begin, int end, const SpanKernel::Match &match, bool in )
+{
+  const __m256i target = _mm256_set1_epi32( match.target ), color = _mm256_set1_epi32( match.color );
+  const __m256i tolerance = _mm256_set1_epi8( match.tolerance );
+  const int flip = (in ? 0 : 0xff);
+  for( ; begin + 8 <= end; begin += 8 )
+  {
+    const int bits = inside8( _mm256_loadu_si256( reinterpret_cast< const __m256i * >( row + begin ) ), target, color, tolerance ) ^ flip;
+    if( bits )
+      return begin + __builtin_ctz( bits );
+  }
+  return findScalar( row, begin, end, match, in );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static int findBackAVX2 ( const std::uint32_t *row, int begin, int end, const SpanKernel::Match &match, bool in )
+{
+  const __m256i target = _mm256_set1_epi32( match.target ), color = _mm256_set1_epi32( match.color );
+  const __m256i tolerance = _mm256_set1_epi8( match.tolerance );
+  const int flip = (in ? 0 : 0xff);
+  for( ; end - 8 >= begin; end -= 8 )
+  {
+    const int bits = inside8( _mm256_loadu_si256( reinterpret_cast< const __m256i * >( row + end - 8 ) ), target, color, tolerance ) ^ flip;
+    if( bits )
+      return end - 8 + (31 - __builtin_clz( bits ));
+  }
+  return findBackScalar( row, begin, end, match, in );
+}
+
+#endif // #ifdef FILL_X86
+
+
+
+// Rows
+// ----
+
+// The rows of an image are split into tiles, so spans are searched tile by
+// tile.
+
+namespace
+{
+
+  struct Rows
+  {
+    const Image &image;
+    const SpanKernel &kernel;
+    const SpanKernel::Match &match;
+
+    const std::uint32_t *row ( int x, int y ) const { return reinterpret_cast< const std::uint32_t * >( image.pixel( x, y ) ); }
+
+    int find ( int y, int begin, int end, bool in ) const
+    {
+      while( begin < end )
+      {
+        const int x0 = begin - begin % Image::tileSize, stop = std::min( end, x0 + Image::tileSize );
+        const int k = x0 + kernel.find( row( x0, y ), begin - x0, stop - x0, match, in );
+        if( k < stop )
+          return k;
+        begin = stop;
+      }
+      return end;
+    }
+
+    int findBack ( int y, int begin, int end, bool in ) const
+    {
+      while( begin < end )
+      {
+        const int x0 = (end-1) - (end-1) % Image::tileSize, start = std::max( begin, x0 );
+        const int k = x0 + kernel.findBack( row( x0, y ), start - x0, end - x0, match, in );
+        if( k >= start )
+          return k;
+        end = start;
+      }
+      return begin-1;
+    }
+  };
+
+} // anonymous namespace
+
+
+
+// Implementation of Auxiliary Functions
+// -------------------------------------
+
+const std::vector< SpanKernel > &spanKernels ()
+{
+  static const std::vector< SpanKernel > kernels = [] () {
+      std::vector< SpanKernel > kernels;
+      kernels.push_back( SpanKernel{ "scalar", findScalar, findBackScalar } );
+#ifdef FILL_X86
+      __builtin_cpu_init();
+      if( __builtin_cpu_supports( "sse2" ) )
+        kernels.push_back( SpanKernel{ "sse2", findSSE2, findBackSSE2 } );
+      if( __builtin_cpu_supports( "avx2" ) )
+        kernels.push_back( SpanKernel{ "avx2", findAVX2, findBackAVX2 } );
+#endif // #ifdef FILL_X86
+      return kernels;
+    } ();
+  return kernels;
+}
+
+
+const SpanKernel &spanKernel ()
+{
+  static const SpanKernel &kernel = spanKernels().back();
+  return kernel;
+}
+
+
+SDL_Rect floodFill ( Image &image, int x, int y, Uint8 r, Uint8 g, Uint8 b, Uint8 tolerance, const SpanKernel &kernel )
+{
+  const int width = image.width(), height = image.height();
+  if( (x < 0) || (x >= width) || (y < 0) || (y >= height) )
+    return SDL_Rect{ 0, 0, 0, 0 };
+
+  SpanKernel::Match match;
+  std::memcpy( &match.target, static_cast< const Image & >( image ).pixel( x, y ), sizeof( match.target ) );
+  const std::uint8_t color[ 4 ] = { r, g, b, 255 };
+  std::memcpy( &match.color, color, sizeof( match.color ) );
+  match.tolerance = tolerance;
+
+  const Rows rows{ image, kernel, match };
+  int left = width, right = -1, top = height, bottom = -1;
+
+  // seeds are the leftmost pixels of spans still to be filled
+  std::vector< std::pair< int, int > > seeds( 1, std::make_pair( x, y ) );
+  for( unsigned long spans = 1; !seeds.empty(); ++spans )
+  {
+    // large fills must not page in the whole image (no pointers are held here)
+    if( spans % Image::tileSize == 0 )
+      image.trim();
+
+    std::tie( x, y ) = seeds.back();
+    seeds.pop_back();
+
+    if( rows.find( y, x, x+1, true ) != x )
+      continue;
+
+    const int begin = rows.findBack( y, 0, x, false ) + 1;
+    const int end = rows.find( y, x+1, width, false );
+    for( int x0 = begin - begin % Image::tileSize; x0 < end; x0 += Image::tileSize )
+    {
+      std::uint32_t *row = reinterpret_cast< std::uint32_t * >( image.pixel( x0, y ) );
+      std::fill( row + std::max( begin - x0, 0 ), row + std::min( end - x0, int( Image::tileSize ) ), match.color );
+    }
+
+    left = std::min( left, begin );
+    right = std::max( right, end-1 );
+    top = std::min( top, y );
+    bottom = std::max( bottom, y );
+
+    // find the spans adjacent to the filled one
+    for( int ny : { y-1, y+1 } )
+    {
+      if( (ny < 0) || (ny >= height) )
+        continue;
+      for( int nx = rows.find( ny, begin, end, true ); nx < end; nx = rows.find( ny, nx, end, true ) )
+      {
+        seeds.emplace_back( nx, ny );
+        nx = rows.find( ny, nx, end, false );
+      }
+    }
+  }
+
+  if( right < left )
+    return SDL_Rect{ 0, 0, 0, 0 };
+  return SDL_Rect{ left, top, right - left + 1, bottom - top + 1 };
+}
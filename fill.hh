@@ -0,0 +1,55 @@
+#ifndef FILL_HH
+#define FILL_HH
+
+#include <cstdint>
+
+#include <vector>
+
+#include <SDL.h>
+
+#include "image.hh"
+
+
+// SpanKernel
+// ----------
+//
+// Searches a row of RGBA pixels for the ends of a span to be flood filled.
+// A pixel lies inside the span if each of its channels differs from the
+// target by at most the tolerance and it does not already have the fill
+// colour (so filling always terminates).
+
+struct SpanKernel
+{
+  struct Match
+  {
+    std::uint32_t target, color;
+    std::uint8_t tolerance;
+  };
+
+  // first index in [begin, end) whose insideness equals inside, or end
+  typedef int (*Find) ( const std::uint32_t *row, int begin, int end, const Match &match, bool inside );
+  // last index in [begin, end) whose insideness equals inside, or begin-1
+  typedef int (*FindBack) ( const std::uint32_t *row, int begin, int end, const Match &match, bool inside );
+
+  const char *name;
+  Find find;
+  FindBack findBack;
+};
+
+
+
+// Auxiliary Functions
+// -------------------
+
+// all kernels supported by the CPU we are running on, the fastest one last
+const std::vector< SpanKernel > &spanKernels ();
+
+// the fastest kernel supported by the CPU we are running on
+const SpanKernel &spanKernel ();
+
+// flood fill the region containing (x, y), returning its bounding box; only
+// tiles actually filled are modified
+SDL_Rect floodFill ( Image &image, int x, int y, Uint8 r, Uint8 g, Uint8 b, Uint8 tolerance,
+                     const SpanKernel &kernel = spanKernel() );
+
+#endif // #ifndef FILL_HH
@@ -0,0 +1,213 @@
+#ifndef HISTORY_HH
+#define HISTORY_HH
+
+#include <cstddef>
+#include <cstdint>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <SDL.h>
+
+#include "image.hh"
+
+
+// History
+// -------
+//
+// Undo / redo history of a stack of images (layers). A step only stores the
+// tiles changed between begin() and commit(); these are found by comparing
+// the shared tile pointers, since writing to an image unshares its tiles.
+// Layers may be added, but never removed. The tiles before
+// and after the step are kept run-length encoded, sharing the encoding with
+// paged out tiles. If the history exceeds its capacity (in bytes), the oldest
+// steps are dropped.
+
+class History
+{
+  typedef Image::Tile::Data Data;
+
+  struct Change
+  {
+    int layer, tile;
+    Data before, after;
+  };
+
+  struct Step
+  {
+    std::vector< Change > changes;
+    std::size_t size = 0;
+  };
+
+  // encode a tile, encoding tiles shared by several indices only once
+  static Data encode ( const Image::SharedTile &tile, std::map< const Image::Tile *, Data > &cache, std::size_t &size )
+  {
+    Data &data = cache[ tile.get() ];
+    if( !data )
+    {
+      data = tile->data();
+      size += data->size();
+    }
+    return data;
+  }
+
+  // restore tiles paged out, sharing the tiles restored from the same data
+  template< class F >
+  static void restore ( std::vector< Image > &layers, const std::vector< Change > &changes, Data Change::*data, F &&restored )
+  {
+    std::map< const std::vector< std::uint8_t > *, std::shared_ptr< Image::Tile > > cache;
+    for( const Change &change : changes )
+    {
+      std::shared_ptr< Image::Tile > &tile = cache[ (change.*data).get() ];
+      if( !tile )
+        tile = std::make_shared< Image::Tile >( change.*data );
+      Image &image = layers[ change.layer ];
+      image.setTile( change.tile, tile );
+      restored( image.tileRect( change.tile ) );
+    }
+  }
+
+public:
+  explicit History ( std::size_t capacity = 64u << 20 )
+    : capacity_( capacity )
+  {}
+
+  std::size_t capacity () const { return capacity_; }
+  void setCapacity ( std::size_t capacity )
+  {
+    capacity_ = capacity;
+    shrink();
+  }
+
+  // memory used by the stored steps (in bytes)
+  std::size_t size () const { return size_; }
+
+  bool recording () const { return !checkpoint_.empty(); }
+  bool canUndo () const { return (position_ > 0); }
+  bool canRedo () const { return (position_ < steps_.size()); }
+
+  void begin ( const std::vector< Image > &layers )
+  {
+    checkpoint_.resize( layers.size() );
+    for( std::size_t l = 0; l < layers.size(); ++l )
+    {
+      checkpoint_[ l ].resize( layers[ l ].tileCount() );
+      for( int k = 0; k < layers[ l ].tileCount(); ++k )
+        checkpoint_[ l ][ k ] = layers[ l ].tile( k );
+    }
+  }
+
+  // layers added since begin() are not part of the step (they are blank)
+  void commit ( const std::vector< Image > &layers )
+  {
+    if( !recording() )
+      return;
+
+    Step step;
+    std::map< const Image::Tile *, Data > cache;
+    for( std::size_t l = 0; l < checkpoint_.size(); ++l )
+    {
+      for( int k = 0; k < layers[ l ].tileCount(); ++k )
+      {
+        const Image::SharedTile tile = layers[ l ].tile( k );
+        if( tile != checkpoint_[ l ][ k ] )
+          step.changes.push_back( Change{ int( l ), k, encode( checkpoint_[ l ][ k ], cache, step.size ), encode( tile, cache, step.size ) } );
+      }
+    }
+    checkpoint_.clear();
+
+    if( step.changes.empty() )
+      return;
+
+    // a new step discards the steps undone before
+    while( canRedo() )
+    {
+      size_ -= steps_.back().size;
+      steps_.pop_back();
+    }
+    size_ += step.size;
+    steps_.push_back( std::move( step ) );
+    position_ = steps_.size();
+    shrink();
+  }
+
+  // abandon the step in progress, calling restored( rect ) for each restored
+  // tile
+  template< class F >
+  void rollback ( std::vector< Image > &layers, F &&restored )
+  {
+    if( !recording() )
+      return;
+    std::map< const Image::Tile *, std::shared_ptr< Image::Tile > > cache;
+    for( std::size_t l = 0; l < checkpoint_.size(); ++l )
+    {
+      for( int k = 0; k < layers[ l ].tileCount(); ++k )
+      {
+        const Image::SharedTile &before = checkpoint_[ l ][ k ];
+        if( layers[ l ].tile( k ) == before )
+          continue;
+        std::shared_ptr< Image::Tile > &tile = cache[ before.get() ];
+        if( !tile )
+          tile = std::make_shared< Image::Tile >( before->data() );
+        layers[ l ].setTile( k, tile );
+        restored( layers[ l ].tileRect( k ) );
+      }
+    }
+    checkpoint_.clear();
+  }
+
+  // undo the last step, calling restored( rect ) for each restored tile
+  template< class F >
+  bool undo ( std::vector< Image > &layers, F &&restored )
+  {
+    if( !canUndo() )
+      return false;
+    restore( layers, steps_[ --position_ ].changes, &Change::before, restored );
+    return true;
+  }
+
+  // redo the last step undone, calling restored( rect ) for each restored tile
+  template< class F >
+  bool redo ( std::vector< Image > &layers, F &&restored )
+  {
+    if( !canRedo() )
+      return false;
+    restore( layers, steps_[ position_++ ].changes, &Change::after, restored );
+    return true;
+  }
+
+  void clear ()
+  {
+    steps_.clear();
+    checkpoint_.clear();
+    position_ = size_ = 0;
+  }
+
+private:
+  void shrink ()
+  {
+    while( (size_ > capacity_) && !steps_.empty() )
+    {
+      // without the step before them, steps to redo cannot be restored
+      if( position_ == 0 )
+      {
+        steps_.clear();
+        size_ = 0;
+        return;
+      }
+      size_ -= steps_.front().size;
+      steps_.pop_front();
+      --position_;
+    }
+  }
+
+  std::size_t capacity_;
+  std::size_t size_ = 0;
+  std::deque< Step > steps_;
+  std::size_t position_ = 0;
+  std::vector< std::vector< Image::SharedTile > > checkpoint_;   // per layer
+};
+
+#endif // #ifndef HISTORY_HH
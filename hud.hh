@@ -0,0 +1,130 @@
+#ifndef HUD_HH
+#define HUD_HH
+
+#include <cctype>
+#include <cstddef>
+
+#include <algorithm>
+#include <vector>
+
+#include <SDL.h>
+
+#include "rect.hh"
+#include "stats.hh"
+
+
+// Hud
+// ---
+//
+// Overlay of a few lines of text and a histogram, drawn on top of everything
+// (see Screen::hud). Text is set in a built-in font of 3x5 pixels, so no font
+// library is needed, and the whole overlay is drawn with three calls filling
+// rectangles. Only upper case letters, digits and a few symbols are known.
+
+class Hud
+{
+  // rows of a glyph, top to bottom, three pixels each
+  static const char *glyph ( char c )
+  {
+    static const char *const digits[] = {
+        "####.##.##.####", ".#.##..#..#.###", "###..#####..###", "###..#.##..####", "#.##.####..#..#",
+        "####..###..####", "####..####.####", "###..#..#.#..#.", "####.#####.####", "####.####..####"
+      };
+    static const char *const letters[] = {
+        ".#.#.#####.##.#", "##.#.###.#.###.", ".###..#..#...##", "##.#.##.##.###.", "####..##.#..###",
+        "####..##.#..#..", ".###..#.##.#.##", "#.##.#####.##.#", "###.#..#..#.###", "..#..#..##.#.#.",
+        "#.##.###.#.##.#", "#..#..#..#..###", "#.########.##.#", "##.#.##.##.##.#", ".#.#.##.##.#.#.",
+        "##.#.###.#..#..", ".#.#.##.###..##", "##.#.###.#.##.#", ".###...#...###.", "###.#..#..#..#.",
+        "#.##.##.##.####", "#.##.##.##.#.#.", "#.##.########.#", "#.##.#.#.#.##.#", "#.##.#.#..#..#.",
+        "###..#.#.#..###"
+      };
+    if( (c >= '0') && (c <= '9') )
+      return digits[ c - '0' ];
+    c = char( std::toupper( static_cast< unsigned char >( c ) ) );
+    if( (c >= 'A') && (c <= 'Z') )
+      return letters[ c - 'A' ];
+    switch( c )
+    {
+    case '.': return ".............#.";
+    case ':': return "....#.....#....";
+    case '%': return "#.#..#.#.#..#.#";
+    case '/': return "..#..#.#.#..#..";
+    case '-': return "......###......";
+    case '(': return ".#.#..#..#...#.";
+    case ')': return ".#...#..#..#.#.";
+    default: return nullptr;
+    }
+  }
+
+public:
+  // each pixel of the font is scale x scale screen pixels
+  explicit Hud ( int scale = 2 )
+    : scale_( scale )
+  {}
+
+  int scale () const { return scale_; }
+  int lineHeight () const { return 7*scale_; }
+
+  void clear ()
+  {
+    text_.clear();
+    bars_.clear();
+    bounds_ = SDL_Rect{ 0, 0, 0, 0 };
+  }
+
+  // add a line of text with its top left corner at (x, y)
+  void text ( int x, int y, const char *text )
+  {
+    const int x0 = x;
+    for( ; *text; ++text, x += 4*scale_ )
+    {
+      const char *rows = glyph( *text );
+      for( int k = 0; rows && (k < 15); ++k )
+      {
+        if( rows[ k ] == '#' )
+          text_.push_back( SDL_Rect{ x + (k % 3)*scale_, y + (k / 3)*scale_, scale_, scale_ } );
+      }
+    }
+    ::unite( bounds_, SDL_Rect{ x0, y, x - x0, 5*scale_ } );
+  }
+
+  // add a histogram of some samples with bins of the given width, the last
+  // bin collecting everything beyond; the bars are scaled to the fullest bin
+  template< std::size_t n >
+  void histogram ( const SDL_Rect &rect, const Samples< n > &samples, double width, int bins )
+  {
+    std::vector< int > counts( bins, 0 );
+    for( std::size_t k = 0; k < samples.size(); ++k )
+      ++counts[ std::min( std::max( int( samples.recent( k ) / width ), 0 ), bins-1 ) ];
+    const int max = std::max( *std::max_element( counts.begin(), counts.end() ), 1 );
+    const int w = std::max( rect.w / bins, 1 );
+    for( int k = 0; k < bins; ++k )
+    {
+      const int h = counts[ k ] * rect.h / max;
+      if( h > 0 )
+        bars_.push_back( SDL_Rect{ rect.x + k*w, rect.y + rect.h - h, std::max( w - 1, 1 ), h } );
+    }
+    ::unite( bounds_, rect );
+  }
+
+  // draw everything added since clear() on a translucent background
+  void render ( SDL_Renderer *renderer ) const
+  {
+    const SDL_Rect background{ bounds_.x - 2*scale_, bounds_.y - 2*scale_, bounds_.w + 4*scale_, bounds_.h + 4*scale_ };
+    SDL_SetRenderDrawBlendMode( renderer, SDL_BLENDMODE_BLEND );
+    SDL_SetRenderDrawColor( renderer, 0, 0, 0, 192 );
+    SDL_RenderFillRect( renderer, &background );
+    SDL_SetRenderDrawBlendMode( renderer, SDL_BLENDMODE_NONE );
+    SDL_SetRenderDrawColor( renderer, 255, 192, 0, 255 );
+    SDL_RenderFillRects( renderer, bars_.data(), int( bars_.size() ) );
+    SDL_SetRenderDrawColor( renderer, 255, 255, 255, 255 );
+    SDL_RenderFillRects( renderer, text_.data(), int( text_.size() ) );
+  }
+
+private:
+  int scale_;
+  std::vector< SDL_Rect > text_, bars_;
+  SDL_Rect bounds_ = SDL_Rect{ 0, 0, 0, 0 };
+};
+
+#endif // #ifndef HUD_HH
@@ -0,0 +1,338 @@
+#ifndef IMAGE_HH
+#define IMAGE_HH
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <SDL.h>
+
+#include "rect.hh"
+#include "rle.hh"
+
+
+// Image
+// -----
+//
+// CPU-side RGBA image in the byte order of SDL_PIXELFORMAT_ABGR8888. The
+// pixels are stored in square tiles, which are shared copy-on-write. Hence,
+// a uniformly filled image costs a single tile.
+//
+// Tiles not used recently are paged out, i.e., only their run-length encoded
+// pixels are kept. Accessing a tile pages it in again. Paging out happens
+// only in trim(), so pointers into the tiles stay valid until then. Tiles
+// intersecting the pinned rectangle (e.g., the visible ones) stay resident.
+
+class Image
+{
+public:
+  static constexpr int tileSize = 128;
+  static constexpr int tilePitch = 4*tileSize;
+
+  class Tile
+  {
+    typedef std::array< std::uint8_t, tilePitch*tileSize > Pixels;
+
+  public:
+    typedef std::shared_ptr< const std::vector< std::uint8_t > > Data;
+
+    Tile () : pixels_( new Pixels ) {}
+
+    // paged out tile
+    explicit Tile ( Data data ) : data_( std::move( data ) ) {}
+
+    Tile ( const Tile &other ) : pixels_( new Pixels ) { std::memcpy( pixels_->data(), other.pixels(), pixels_->size() ); }
+
+    Tile &operator= ( const Tile & ) = delete;
+
+    const std::uint8_t *pixels () const { return pageIn().data(); }
+
+    // writing invalidates the encoding
+    std::uint8_t *pixels ()
+    {
+      Pixels &pixels = pageIn();
+      data_.reset();
+      return pixels.data();
+    }
+
+    // run-length encoded pixels (encoded once, then shared)
+    const Data &data () const
+    {
+      if( !data_ )
+        data_ = std::make_shared< const std::vector< std::uint8_t > >( rle::encode( pixels(), tileSize*tileSize ) );
+      return data_;
+    }
+
+    bool resident () const { return bool( pixels_ ); }
+
+    // add the colours to a palette, from the encoding if there is one (never
+    // encodes the tile); returns false if they do not fit
+    bool collect ( Palette &palette ) const
+    {
+      if( data_ )
+        return rle::collect( *data_, palette );
+      return palette.add( pixels_->data(), tileSize*tileSize );
+    }
+
+    // is the tile filled with a single colour?
+    bool uniform () const
+    {
+      const std::vector< std::uint8_t > &data = *this->data();
+      return (data.size() == 7) && (data[ 0 ] == rle::runs);
+    }
+
+    // is the tile known to be fully transparent? (never encodes the tile, so
+    // tiles written since their last encoding are not)
+    bool transparent () const { return data_ && (data_->size() == 7) && ((*data_)[ 0 ] == rle::runs) && ((*data_)[ 6 ] == 0); }
+
+    void pageOut () const
+    {
+      data();
+      pixels_.reset();
+    }
+
+    mutable std::uint64_t used = 0;   // time of the last access (see Image::trim)
+
+  private:
+    Pixels &pageIn () const
+    {
+      if( !pixels_ )
+      {
+        pixels_.reset( new Pixels );
+        rle::decode( *data_, pixels_->data(), tileSize*tileSize );
+      }
+      return *pixels_;
+    }
+
+    mutable std::unique_ptr< Pixels > pixels_;
+    mutable Data data_;
+  };
+
+  typedef std::shared_ptr< const Tile > SharedTile;
+
+  Image ( int width, int height, Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255 )
+    : width_( width ), height_( height ),
+      tilesX_( (width + tileSize-1) / tileSize ), tilesY_( (height + tileSize-1) / tileSize ),
+      tiles_( tilesX_*tilesY_ )
+  {
+    fill( r, g, b, a );
+  }
+
+  int width () const { return width_; }
+  int height () const { return height_; }
+
+  int tilesX () const { return tilesX_; }
+  int tilesY () const { return tilesY_; }
+
+  SDL_Rect rect () const { return SDL_Rect{ 0, 0, width_, height_ }; }
+  SDL_Rect tileRect ( int i, int j ) const
+  {
+    SDL_Rect rect{ i*tileSize, j*tileSize, tileSize, tileSize };
+    intersect( rect, this->rect(), rect );
+    return rect;
+  }
+
+  // tiles are also addressed by their index k = j*tilesX() + i
+  int tileCount () const { return tilesX_*tilesY_; }
+  SDL_Rect tileRect ( int k ) const { return tileRect( k % tilesX_, k / tilesX_ ); }
+
+  // share a tile, e.g., to keep a copy of the current contents; writing to the
+  // image unshares it (hence, shared tiles are never modified)
+  SharedTile tile ( int k ) const { return tiles_[ k ]; }
+  void setTile ( int k, SharedTile tile ) { tiles_[ k ] = std::const_pointer_cast< Tile >( std::move( tile ) ); }
+
+  void fill ( Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255 )
+  {
+    std::shared_ptr< Tile > tile = std::make_shared< Tile >();
+    std::uint8_t *pixels = tile->pixels();
+    for( int k = 0; k < tileSize*tileSize; ++k )
+    {
+      pixels[ 4*k ] = r;
+      pixels[ 4*k+1 ] = g;
+      pixels[ 4*k+2 ] = b;
+      pixels[ 4*k+3 ] = a;
+    }
+    tile->data();   // so the tile is known to be uniform (see Tile::transparent)
+    std::fill( tiles_.begin(), tiles_.end(), tile );
+  }
+
+  const std::uint8_t *pixel ( int x, int y ) const
+  {
+    return tile( x / tileSize, y / tileSize ).pixels() + (y % tileSize)*tilePitch + 4*(x % tileSize);
+  }
+
+  std::uint8_t *pixel ( int x, int y )
+  {
+    return writableTile( x / tileSize, y / tileSize ).pixels() + (y % tileSize)*tilePitch + 4*(x % tileSize);
+  }
+
+  // call f( pixels, pitch, part ) for each tile intersecting rect
+  template< class F >
+  void forEachTile ( SDL_Rect rect, F &&f ) const
+  {
+    if( !intersect( rect, this->rect(), rect ) )
+      return;
+    for( int j = rect.y / tileSize; j*tileSize < rect.y + rect.h; ++j )
+    {
+      for( int i = rect.x / tileSize; i*tileSize < rect.x + rect.w; ++i )
+      {
+        SDL_Rect part;
+        intersect( rect, tileRect( i, j ), part );
+        f( pixel( part.x, part.y ), int( tilePitch ), static_cast< const SDL_Rect & >( part ) );
+      }
+    }
+  }
+
+  // same as forEachTile, but the tiles are unshared before f may modify them
+  template< class F >
+  void modifyTiles ( SDL_Rect rect, F &&f )
+  {
+    if( !intersect( rect, this->rect(), rect ) )
+      return;
+    for( int j = rect.y / tileSize; j*tileSize < rect.y + rect.h; ++j )
+    {
+      for( int i = rect.x / tileSize; i*tileSize < rect.x + rect.w; ++i )
+      {
+        SDL_Rect part;
+        intersect( rect, tileRect( i, j ), part );
+        f( pixel( part.x, part.y ), int( tilePitch ), static_cast< const SDL_Rect & >( part ) );
+      }
+    }
+  }
+
+  void read ( const SDL_Rect &rect, std::uint8_t *dst, int pitch ) const
+  {
+    forEachTile( rect, [ &rect, dst, pitch ] ( const std::uint8_t *src, int srcPitch, const SDL_Rect &part ) {
+        std::uint8_t *out = dst + (part.y - rect.y)*pitch + 4*(part.x - rect.x);
+        for( int y = 0; y < part.h; ++y, src += srcPitch, out += pitch )
+          std::memcpy( out, src, 4*part.w );
+      } );
+  }
+
+  void write ( const SDL_Rect &rect, const std::uint8_t *src, int pitch )
+  {
+    modifyTiles( rect, [ &rect, src, pitch ] ( std::uint8_t *dst, int dstPitch, const SDL_Rect &part ) {
+        const std::uint8_t *in = src + (part.y - rect.y)*pitch + 4*(part.x - rect.x);
+        for( int y = 0; y < part.h; ++y, in += pitch, dst += dstPitch )
+          std::memcpy( dst, in, 4*part.w );
+      } );
+  }
+
+  // a copy sharing no tiles, only their (immutable) encodings, so another
+  // thread may read it; the tiles written since their last encoding are
+  // encoded here
+  Image detach () const
+  {
+    Image image( *this );
+    for( int k = 0; k < tileCount(); ++k )
+      image.tiles_[ k ] = ((k > 0) && (tiles_[ k ] == tiles_[ k-1 ]) ? image.tiles_[ k-1 ] : std::make_shared< Tile >( tiles_[ k ]->data() ));
+    return image;
+  }
+
+  // is the image filled by fill() with the given colour? (images merely
+  // looking uniform are not recognized)
+  bool filled ( Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255 ) const
+  {
+    const std::uint8_t color[] = { r, g, b, a };
+    return std::all_of( tiles_.begin(), tiles_.end(), [ this ] ( const std::shared_ptr< Tile > &tile ) { return (tile == tiles_.front()); } )
+      && tiles_.front()->uniform() && (std::memcmp( tiles_.front()->pixels(), color, 4 ) == 0);
+  }
+
+  std::unique_ptr< std::uint8_t[] > pixels () const
+  {
+    std::unique_ptr< std::uint8_t[] > pixels( new std::uint8_t[ 4*width_*height_ ] );
+    read( rect(), pixels.get(), 4*width_ );
+    return pixels;
+  }
+
+  // maximum number of resident tiles kept by trim()
+  std::size_t capacity () const { return capacity_; }
+  void setCapacity ( std::size_t capacity ) { capacity_ = capacity; }
+
+  const SDL_Rect &pinned () const { return pinned_; }
+  void pin ( const SDL_Rect &rect ) { pinned_ = rect; }
+
+  // page out the least recently used tiles exceeding the capacity; pointers
+  // into paged out tiles become invalid
+  void trim ()
+  {
+    ++time_;
+
+    std::vector< const Tile * > resident;
+    for( int k = 0; k < tileCount(); ++k )
+    {
+      const Tile &tile = *tiles_[ k ];
+      SDL_Rect pinned;
+      if( tile.resident() && !intersect( tileRect( k ), pinned_, pinned ) )
+        resident.push_back( &tile );
+    }
+    if( resident.size() <= capacity_ )
+      return;
+
+    // shared tiles occur more than once
+    std::sort( resident.begin(), resident.end() );
+    resident.erase( std::unique( resident.begin(), resident.end() ), resident.end() );
+    if( resident.size() <= capacity_ )
+      return;
+
+    auto end = resident.end() - capacity_;
+    std::nth_element( resident.begin(), end, resident.end(), [] ( const Tile *a, const Tile *b ) { return (a->used < b->used); } );
+    for( auto pos = resident.begin(); pos != end; ++pos )
+      (*pos)->pageOut();
+  }
+
+  // page out all tiles, e.g., of an image not shown
+  void pageOut ()
+  {
+    for( const std::shared_ptr< Tile > &tile : tiles_ )
+    {
+      if( tile->resident() )
+        tile->pageOut();
+    }
+  }
+
+  // number of distinct resident tiles
+  std::size_t resident () const
+  {
+    std::vector< const Tile * > resident;
+    for( const std::shared_ptr< Tile > &tile : tiles_ )
+    {
+      if( tile->resident() )
+        resident.push_back( tile.get() );
+    }
+    std::sort( resident.begin(), resident.end() );
+    return std::unique( resident.begin(), resident.end() ) - resident.begin();
+  }
+
+private:
+  const Tile &tile ( int i, int j ) const
+  {
+    const Tile &tile = *tiles_[ j*tilesX_ + i ];
+    tile.used = time_;
+    return tile;
+  }
+
+  Tile &writableTile ( int i, int j )
+  {
+    std::shared_ptr< Tile > &tile = tiles_[ j*tilesX_ + i ];
+    if( tile.use_count() > 1 )
+      tile = std::make_shared< Tile >( *tile );
+    tile->used = time_;
+    return *tile;
+  }
+
+  int width_, height_;
+  int tilesX_, tilesY_;
+  std::vector< std::shared_ptr< Tile > > tiles_;
+
+  std::size_t capacity_ = std::numeric_limits< std::size_t >::max();
+  SDL_Rect pinned_ = SDL_Rect{ 0, 0, 0, 0 };
+  std::uint64_t time_ = 0;
+};
+
+#endif // #ifndef IMAGE_HH
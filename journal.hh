@@ -0,0 +1,542 @@
+#ifndef JOURNAL_HH
+#define JOURNAL_HH
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "brush.hh"
+#include "screen.hh"
+#include "varint.hh"
+
+
+// Journal
+// -------
+//
+// Append-only binary log of everything mutating the canvas. Each record
+// consists of a tag byte, the time since the previous record (in
+// milliseconds) and the arguments. Integers are stored as (zigzag) varints;
+// coordinates are quantized to 1/16 pixel and stored relative to the
+// previous coordinate. A typical motion takes less than 10 bytes.
+//
+// The journal is flushed whenever a stroke ends, so a crash loses at most the
+// strokes in progress. replay() reads a journal, stopping at a truncated
+// record, and feeds it into a canvas as fast as possible. Before appending to
+// a journal, a truncated record must be cut off (see ReplayStatistics::valid).
+//
+// So the journal does not grow forever, it is restarted from a checkpoint
+// whenever the canvas is cleared or loaded (see Canvas::restartJournal);
+// checkpoints hold drawings as PNG images and are written in the background.
+
+class Journal
+{
+public:
+  enum Tag : std::uint8_t { session = 0, down = 1, move = 2, up = 3, color = 4, clear = 5, load = 6, undo = 7, redo = 8, fill = 9, brush = 10, layer = 11, open = 12, image = 13, view = 14 };
+
+  static const char *magic () { return "KDJ1"; }
+  static constexpr std::size_t magicSize = 4;
+  static constexpr float resolution = 16.0f;
+
+  explicit Journal ( const std::string &file )
+    : Journal( file, std::ios::app )
+  {}
+
+  ~Journal ()
+  {
+    if( restart_.valid() )
+      finish();
+  }
+
+  // replace the journal by a new one starting from a checkpoint, which
+  // writes its records into the journal passed. The checkpoint is written on
+  // a thread of its own, so it must not share any state with the caller.
+  // Once written, the records appended meanwhile are copied over and the new
+  // journal replaces the old one atomically; until then (or if it cannot be
+  // written), the old journal remains complete. Returns false if a restart
+  // is still in progress.
+  template< class F >
+  bool restart ( F checkpoint )
+  {
+    if( restarting() )
+      return false;
+
+    // the records copied over start with a session, so their coordinates do
+    // not depend on the records before
+    out_.flush();
+    tail_ = out_.tellp();
+    x_ = y_ = 0;
+    begin();
+    out_.flush();
+
+    restart_ = std::async( std::launch::async, [ this, file = file_ + ".new", checkpoint = std::move( checkpoint ) ] () mutable {
+        bool written = false;
+        try
+        {
+          Journal journal( file, std::ios::trunc );
+          checkpoint( journal );
+          journal.out_.flush();
+          written = bool( journal.out_ );
+        }
+        catch( const std::exception & )
+        {}
+        checkpointed_ = true;
+        return written;
+      } );
+    return true;
+  }
+
+  // is a restart in progress? (finishes it if the checkpoint is written)
+  bool restarting ()
+  {
+    if( checkpointed_ )
+      finish();
+    return restart_.valid();
+  }
+
+  void recordDown ( const Pointer &pointer, float x, float y )
+  {
+    tag( down );
+    writePointer( pointer );
+    writePoint( x, y );
+  }
+
+  void recordMove ( const Pointer &pointer, float x, float y, float dx, float dy )
+  {
+    tag( move );
+    writePointer( pointer );
+    writePoint( x, y );
+    writeSigned( out_, quantize( dx ) );
+    writeSigned( out_, quantize( dy ) );
+  }
+
+  void recordUp ( const Pointer &pointer, float x, float y )
+  {
+    tag( up );
+    writePointer( pointer );
+    writePoint( x, y );
+    out_.flush();
+  }
+
+  void recordColor ( int r, int g, int b )
+  {
+    tag( color );
+    out_.put( char( r ) ).put( char( g ) ).put( char( b ) );
+    out_.flush();
+  }
+
+  void recordClear () { record( clear ); }
+
+  void recordBrush ( float radius, float hardness )
+  {
+    tag( brush );
+    writeFloat( out_, radius );
+    writeFloat( out_, hardness );
+    out_.flush();
+  }
+
+  void recordLoad ( const std::string &file )
+  {
+    tag( load );
+    writeVarint( out_, file.size() );
+    out_.write( file.data(), file.size() );
+    out_.flush();
+  }
+
+  void recordFill ( float x, float y )
+  {
+    tag( fill );
+    writePoint( x, y );
+    out_.flush();
+  }
+
+  // a PNG image replacing the drawing shown (checkpoints only)
+  void recordImage ( const std::string &png )
+  {
+    tag( image );
+    writeVarint( out_, png.size() );
+    out_.write( png.data(), png.size() );
+    out_.flush();
+  }
+
+  // the view (checkpoints only, as it follows from the gestures otherwise)
+  void recordView ( float x, float y, float zoom )
+  {
+    tag( view );
+    writeFloat( out_, x );
+    writeFloat( out_, y );
+    writeFloat( out_, zoom );
+    out_.flush();
+  }
+
+  void recordOpen ( const std::string &name )
+  {
+    tag( open );
+    writeVarint( out_, name.size() );
+    out_.write( name.data(), name.size() );
+    out_.flush();
+  }
+
+  void recordLayer ( int layer )
+  {
+    tag( Journal::layer );
+    writeVarint( out_, layer );
+    out_.flush();
+  }
+
+  void recordUndo () { record( undo ); }
+  void recordRedo () { record( redo ); }
+
+  static std::int64_t quantize ( float x ) { return std::int64_t( std::floor( x * resolution + 0.5f ) ); }
+  static float dequantize ( std::int64_t x ) { return float( x ) / resolution; }
+
+private:
+  Journal ( const std::string &file, std::ios::openmode mode )
+    : file_( file ), out_( file, std::ios::binary | mode )
+  {
+    if( !out_ )
+      throw std::runtime_error( "Unable to open journal '" + file + "'" );
+    begin();
+    out_.flush();
+  }
+
+  void begin ()
+  {
+    if( out_.tellp() == 0 )
+      out_.write( magic(), magicSize );
+
+    // sessions carry the wall clock time, so the records can be dated
+    const auto now = std::chrono::duration_cast< std::chrono::milliseconds >( std::chrono::system_clock::now().time_since_epoch() );
+    tag( session );
+    writeVarint( out_, now.count() );
+  }
+
+  // append the records since the restart to the checkpoint and replace the
+  // journal by it
+  void finish ()
+  {
+    const bool written = restart_.get();
+    checkpointed_ = false;
+
+    const std::string file = file_ + ".new";
+    if( written )
+    {
+      out_.flush();
+      std::ifstream in( file_, std::ios::binary );
+      std::ofstream out( file, std::ios::binary | std::ios::app );
+      if( in.seekg( tail_ ) && (out << in.rdbuf()) && out.flush() && (std::rename( file.c_str(), file_.c_str() ) == 0) )
+      {
+        std::swap( out_, out );
+        return;
+      }
+    }
+    std::remove( file.c_str() );
+  }
+
+  void tag ( Tag tag )
+  {
+    if( checkpointed_ )
+      finish();
+
+    const auto now = std::chrono::steady_clock::now();
+    out_.put( char( tag ) );
+    writeVarint( out_, std::chrono::duration_cast< std::chrono::milliseconds >( now - last_ ).count() );
+    last_ = now;
+  }
+
+  void record ( Tag tag )
+  {
+    this->tag( tag );
+    out_.flush();
+  }
+
+  void writePointer ( const Pointer &pointer )
+  {
+    writeSigned( out_, pointer.touch );
+    writeSigned( out_, pointer.finger );
+  }
+
+  void writePoint ( float x, float y )
+  {
+    const std::int64_t qx = quantize( x ), qy = quantize( y );
+    writeSigned( out_, qx - x_ );
+    writeSigned( out_, qy - y_ );
+    x_ = qx;
+    y_ = qy;
+  }
+
+  std::string file_;
+  std::ofstream out_;
+  std::chrono::steady_clock::time_point last_ = std::chrono::steady_clock::now();
+  std::int64_t x_ = 0, y_ = 0;
+  std::future< bool > restart_;
+  std::streamoff tail_ = 0;                     // start of the records copied over
+  std::atomic< bool > checkpointed_{ false };
+};
+
+
+
+// JournalReader
+// -------------
+
+class JournalReader
+{
+public:
+  struct Record
+  {
+    Journal::Tag tag;
+    std::uint64_t time;         // milliseconds since the previous record
+    Pointer pointer;
+    float x = 0.0f, y = 0.0f, dx = 0.0f, dy = 0.0f;
+    float radius = 0.0f, hardness = 0.0f;
+    int r = 0, g = 0, b = 0;
+    std::uint64_t clock = 0;    // milliseconds since the epoch (session only)
+    std::uint64_t layer = 0;
+    std::string file;
+    std::string name;           // of the canvas session opened
+    std::string png;            // image of a checkpoint
+    float zoom = 1.0f;          // view of a checkpoint (at x, y)
+  };
+
+  explicit JournalReader ( std::istream &in )
+    : in_( in )
+  {
+    char magic[ Journal::magicSize ];
+    if( !in_.read( magic, Journal::magicSize ) || (std::memcmp( magic, Journal::magic(), Journal::magicSize ) != 0) )
+      throw std::runtime_error( "Invalid journal" );
+    valid_ = Journal::magicSize;
+  }
+
+  // read the next record; returns false at the end or at a truncated record
+  bool next ( Record &record )
+  {
+    if( !read( record ) )
+      return false;
+    valid_ = in_.tellg();
+    return true;
+  }
+
+  // size of the journal up to the last complete record
+  std::streamoff valid () const { return valid_; }
+
+private:
+  bool read ( Record &record )
+  {
+    const int tag = in_.get();
+    if( (tag == std::char_traits< char >::eof()) || !readVarint( in_, record.time ) )
+      return false;
+
+    record.tag = Journal::Tag( tag );
+    switch( record.tag )
+    {
+    case Journal::session:
+      // each session starts with absolute coordinates
+      x_ = y_ = 0;
+      return readVarint( in_, record.clock );
+
+    case Journal::down:
+    case Journal::up:
+      return readPointer( record.pointer ) && readPoint( record.x, record.y );
+
+    case Journal::fill:
+      return readPoint( record.x, record.y );
+
+    case Journal::brush:
+      return readFloat( in_, record.radius ) && readFloat( in_, record.hardness );
+
+    case Journal::move:
+      return readPointer( record.pointer ) && readPoint( record.x, record.y ) && readCoordinate( record.dx ) && readCoordinate( record.dy );
+
+    case Journal::layer:
+      return readVarint( in_, record.layer );
+
+    case Journal::color:
+      record.r = in_.get();
+      record.g = in_.get();
+      record.b = in_.get();
+      return bool( in_ );
+
+    case Journal::load:
+      return readString( record.file );
+
+    case Journal::open:
+      return readString( record.name );
+
+    case Journal::image:
+      return readString( record.png, std::uint64_t( 1 ) << 30 );
+
+    case Journal::view:
+      return readFloat( in_, record.x ) && readFloat( in_, record.y ) && readFloat( in_, record.zoom );
+
+    case Journal::clear:
+    case Journal::undo:
+    case Journal::redo:
+      return true;
+
+    default:
+      throw std::runtime_error( "Invalid journal record (tag " + std::to_string( tag ) + ")" );
+    }
+  }
+
+  bool readString ( std::string &value, std::uint64_t maxSize = 4096 )
+  {
+    std::uint64_t size;
+    if( !readVarint( in_, size ) || (size > maxSize) )
+      return false;
+    value.resize( size );
+    return bool( in_.read( &value[ 0 ], size ) );
+  }
+
+  bool readPointer ( Pointer &pointer )
+  {
+    std::int64_t touch, finger;
+    if( !readSigned( in_, touch ) || !readSigned( in_, finger ) )
+      return false;
+    pointer.touch = touch;
+    pointer.finger = finger;
+    return true;
+  }
+
+  bool readCoordinate ( float &x )
+  {
+    std::int64_t q;
+    if( !readSigned( in_, q ) )
+      return false;
+    x = Journal::dequantize( q );
+    return true;
+  }
+
+  bool readPoint ( float &x, float &y )
+  {
+    std::int64_t dx, dy;
+    if( !readSigned( in_, dx ) || !readSigned( in_, dy ) )
+      return false;
+    x_ += dx;
+    y_ += dy;
+    x = Journal::dequantize( x_ );
+    y = Journal::dequantize( y_ );
+    return true;
+  }
+
+  std::istream &in_;
+  std::streamoff valid_ = 0;
+  std::int64_t x_ = 0, y_ = 0;
+};
+
+
+
+// replay
+// ------
+
+struct ReplayStatistics
+{
+  unsigned long records = 0;
+  std::streamoff valid = 0;     // size of the journal up to the last complete record
+  std::uint64_t recorded = 0;   // recorded time in milliseconds
+  double replayed = 0.0;        // time taken to replay in seconds
+};
+
+
+// feed a journal into a canvas (or anything providing the same methods)
+template< class Canvas >
+ReplayStatistics replay ( std::istream &in, Canvas &canvas )
+{
+  const auto start = std::chrono::steady_clock::now();
+  ReplayStatistics statistics;
+
+  JournalReader reader( in );
+  JournalReader::Record record;
+  while( reader.next( record ) )
+  {
+    ++statistics.records;
+    if( record.tag != Journal::session )
+      statistics.recorded += record.time;
+
+    switch( record.tag )
+    {
+    case Journal::session:
+      break;
+    case Journal::down:
+      canvas.down( record.pointer, record.x, record.y );
+      break;
+    case Journal::move:
+      canvas.move( record.pointer, record.x, record.y, record.dx, record.dy );
+      break;
+    case Journal::up:
+      canvas.up( record.pointer, record.x, record.y );
+      break;
+    case Journal::color:
+      canvas.setColor( record.r, record.g, record.b );
+      break;
+    case Journal::clear:
+      canvas.clear();
+      break;
+    case Journal::load:
+      // the snapshot might have been deleted in the meantime
+      try
+      {
+        canvas.load( record.file );
+      }
+      catch( const std::exception & )
+      {}
+      break;
+    case Journal::fill:
+      canvas.fill( record.x, record.y );
+      break;
+    case Journal::brush:
+      {
+        Brush brush;
+        brush.radius = record.radius;
+        brush.hardness = record.hardness;
+        canvas.setBrush( brush );
+      }
+      break;
+    case Journal::layer:
+      canvas.selectLayer( int( record.layer ) );
+      break;
+    case Journal::open:
+      canvas.open( record.name );
+      break;
+    case Journal::image:
+      {
+        std::istringstream png( record.png );
+        canvas.restore( png );
+      }
+      break;
+    case Journal::view:
+      canvas.setView( record.x, record.y, record.zoom );
+      break;
+    case Journal::undo:
+      canvas.undo();
+      break;
+    case Journal::redo:
+      canvas.redo();
+      break;
+    }
+  }
+
+  statistics.valid = reader.valid();
+  statistics.replayed = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+  return statistics;
+}
+
+
+inline std::ostream &operator<< ( std::ostream &out, const ReplayStatistics &statistics )
+{
+  out << "records: " << statistics.records << std::endl;
+  out << "recorded: " << 1e-3 * statistics.recorded << "s" << std::endl;
+  out << "replayed: " << statistics.replayed << "s" << std::endl;
+  return out;
+}
+
+#endif // #ifndef JOURNAL_HH
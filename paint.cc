@@ -0,0 +1,142 @@
+#include <cmath>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <utility>
+
+#include "paint.hh"
+
+
+// Implementation of Capsule
+// -------------------------
+
+SDL_Rect Capsule::bounds () const
+{
+  const int left = int( std::floor( std::min( a.x, b.x ) - radius ) ), right = int( std::ceil( std::max( a.x, b.x ) + radius ) );
+  const int top = int( std::floor( std::min( a.y, b.y ) - radius ) ), bottom = int( std::ceil( std::max( a.y, b.y ) + radius ) );
+  return SDL_Rect{ left, top, right - left + 1, bottom - top + 1 };
+}
+
+
+bool Capsule::span ( float y, float distance, float &left, float &right ) const
+{
+  left = std::numeric_limits< float >::infinity();
+  right = -left;
+
+  // the set is convex, so it is the hull of the caps and the band in between
+  for( const Stroke::Point &p : { a, b } )
+  {
+    const float h2 = distance*distance - (y - p.y)*(y - p.y);
+    if( h2 < 0.0f )
+      continue;
+    const float h = std::sqrt( h2 );
+    left = std::min( left, p.x - h );
+    right = std::max( right, p.x + h );
+  }
+
+  // the band consists of the points projecting into the segment within the
+  // given distance; for horizontal segments it is covered by the caps
+  const float dx = b.x - a.x, dy = b.y - a.y, py = y - a.y;
+  if( dy != 0.0f )
+  {
+    const float length = std::sqrt( dx*dx + dy*dy );
+    float l = (py*dx - distance*length) / dy, r = (py*dx + distance*length) / dy;
+    if( l > r )
+      std::swap( l, r );
+    if( dx != 0.0f )
+    {
+      float pl = -py*dy / dx, pr = (dx*dx + dy*dy - py*dy) / dx;
+      if( pl > pr )
+        std::swap( pl, pr );
+      l = std::max( l, pl );
+      r = std::min( r, pr );
+    }
+    else if( (py*dy < 0.0f) || (py*dy > dy*dy) )
+      l = r + 1.0f;
+    if( l <= r )
+    {
+      left = std::min( left, a.x + l );
+      right = std::max( right, a.x + r );
+    }
+  }
+
+  return (left <= right);
+}
+
+
+
+// Implementation of Auxiliary Functions
+// -------------------------------------
+
+SDL_Rect paintStamp ( Image &image, const Stamp &stamp, int x, int y, Uint8 r, Uint8 g, Uint8 b, const CompositeKernel &kernel )
+{
+  const SDL_Rect rect{ x - stamp.width()/2, y - stamp.height()/2, stamp.width(), stamp.height() };
+  image.modifyTiles( rect, [ &stamp, &rect, &kernel, r, g, b ] ( std::uint8_t *dst, int pitch, const SDL_Rect &part ) {
+      kernel.blend( dst, pitch, stamp.coverage( part.x - rect.x, part.y - rect.y ), stamp.pitch(), part.w, part.h, r, g, b );
+    } );
+  return rect;
+}
+
+
+SDL_Rect paintCapsule ( Image &image, const Capsule &capsule, Uint8 r, Uint8 g, Uint8 b, const CompositeKernel &kernel )
+{
+  const SDL_Rect rect = capsule.bounds();
+  const Falloff falloff( capsule.radius, capsule.hardness );
+  const float inner = capsule.radius - 1.0f / falloff.scale;
+
+  const float ax = capsule.a.x, ay = capsule.a.y;
+  const float dx = capsule.b.x - ax, dy = capsule.b.y - ay;
+  const float length2 = dx*dx + dy*dy;
+  const float scale = (length2 > 0.0f ? 1.0f / length2 : 0.0f);
+
+  // pixel centres lie on integer coordinates, as for stamps; only tiles
+  // actually covered are modified (and hence unshared)
+  std::array< std::uint8_t, Image::tileSize*Image::tileSize > coverage;
+  image.forEachTile( rect, [ & ] ( const std::uint8_t *, int, const SDL_Rect &part ) {
+      bool empty = true;
+      for( int y = 0; y < part.h; ++y )
+      {
+        std::uint8_t *row = coverage.data() + y*part.w;
+        std::fill( row, row + part.w, std::uint8_t( 0 ) );
+
+        // only the pixels within the radius are evaluated; those within the
+        // inner radius (shrunk against rounding errors) are fully covered
+        float left, right;
+        if( !capsule.span( float( part.y + y ), capsule.radius, left, right ) )
+          continue;
+        const int begin = std::max( int( std::floor( left ) ) - part.x, 0 ), end = std::min( int( std::ceil( right ) ) + 1 - part.x, part.w );
+        if( begin >= end )
+          continue;
+        empty = false;
+
+        int solidBegin = end, solidEnd = end;
+        if( (inner > 0.01f) && capsule.span( float( part.y + y ), inner - 0.01f, left, right ) )
+        {
+          solidBegin = std::min( std::max( int( std::ceil( left ) ) - part.x, begin ), end );
+          solidEnd = std::min( std::max( int( std::floor( right ) ) + 1 - part.x, solidBegin ), end );
+        }
+        std::fill( row + solidBegin, row + solidEnd, std::uint8_t( 255 ) );
+
+        const float py = float( part.y + y ) - ay;
+        const auto evaluate = [ row, py, ax, dx, dy, scale, falloff, &part ] ( int from, int to ) {
+            for( int x = from; x < to; ++x )
+            {
+              const float px = float( part.x + x ) - ax;
+              const float t = std::min( std::max( (px*dx + py*dy) * scale, 0.0f ), 1.0f );
+              const float ex = px - t*dx, ey = py - t*dy;
+              row[ x ] = falloff( std::sqrt( ex*ex + ey*ey ) );
+            }
+          };
+        evaluate( begin, solidBegin );
+        evaluate( solidEnd, end );
+      }
+      if( empty )
+        return;
+      image.modifyTiles( part, [ &coverage, &part, &kernel, r, g, b ] ( std::uint8_t *dst, int pitch, const SDL_Rect & ) {
+          kernel.blend( dst, pitch, coverage.data(), part.w, part.w, part.h, r, g, b );
+        } );
+    } );
+  return rect;
+}
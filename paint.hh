@@ -0,0 +1,44 @@
+#ifndef PAINT_HH
+#define PAINT_HH
+
+#include <SDL.h>
+
+#include "composite.hh"
+#include "image.hh"
+#include "stamp.hh"
+#include "stroke.hh"
+
+
+// Capsule
+// -------
+//
+// Line segment from a to b, thickened to the given radius, with the falloff of
+// a round brush of given hardness.
+
+struct Capsule
+{
+  Stroke::Point a, b;
+  float radius, hardness;
+
+  SDL_Rect bounds () const;
+
+  // interval [left, right] of the row y within the given distance of the
+  // segment; returns false if the row misses
+  bool span ( float y, float distance, float &left, float &right ) const;
+};
+
+
+
+// Auxiliary Functions
+// -------------------
+
+// blend a stamp centred at (x, y) into the image, returning the modified area
+SDL_Rect paintStamp ( Image &image, const Stamp &stamp, int x, int y, Uint8 r, Uint8 g, Uint8 b,
+                      const CompositeKernel &kernel = compositeKernel() );
+
+// blend a capsule into the image, evaluating the exact coverage of each pixel
+// once; returns the modified area
+SDL_Rect paintCapsule ( Image &image, const Capsule &capsule, Uint8 r, Uint8 g, Uint8 b,
+                        const CompositeKernel &kernel = compositeKernel() );
+
+#endif // #ifndef PAINT_HH
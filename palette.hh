@@ -0,0 +1,100 @@
+#ifndef PALETTE_HH
+#define PALETTE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <array>
+
+
+// Palette
+// -------
+//
+// Up to 256 distinct 32-bit pixels (byte order R, G, B, A), found by a small
+// open addressing hash table. The app draws with a handful of colours, so
+// most tiles and drawings, including their anti-aliased edges, fit into a
+// palette and can be stored with one index byte per pixel.
+
+class Palette
+{
+  static constexpr int slots = 1024;
+
+  static int hash ( std::uint32_t color ) { return int( (color * 2654435761u) >> 22 ); }
+
+public:
+  static constexpr int capacity = 256;
+
+  Palette () { slots_.fill( -1 ); }
+
+  int size () const { return size_; }
+  std::uint32_t operator[] ( int index ) const { return colors_[ index ]; }
+
+  // the colours as bytes (R, G, B, A)
+  const std::uint8_t *data () const { return reinterpret_cast< const std::uint8_t * >( colors_.data() ); }
+
+  // index of a colour, or -1 if it is not in the palette
+  int find ( std::uint32_t color ) const
+  {
+    for( int slot = hash( color ); slots_[ slot ] >= 0; slot = (slot + 1) % slots )
+    {
+      if( colors_[ slots_[ slot ] ] == color )
+        return slots_[ slot ];
+    }
+    return -1;
+  }
+
+  // index of a colour, adding it if necessary; -1 if the palette is full
+  int add ( std::uint32_t color )
+  {
+    int slot = hash( color );
+    for( ; slots_[ slot ] >= 0; slot = (slot + 1) % slots )
+    {
+      if( colors_[ slots_[ slot ] ] == color )
+        return slots_[ slot ];
+    }
+    if( size_ == capacity )
+      return -1;
+    colors_[ size_ ] = color;
+    slots_[ slot ] = std::int16_t( size_ );
+    return size_++;
+  }
+
+  // add count pixels; returns false if they do not fit
+  bool add ( const std::uint8_t *pixels, std::size_t count )
+  {
+    std::uint32_t last = 0;
+    for( std::size_t k = 0; k < count; ++k )
+    {
+      std::uint32_t color;
+      std::memcpy( &color, pixels + 4*k, 4 );
+      if( ((k == 0) || (color != last)) && (add( color ) < 0) )
+        return false;
+      last = color;
+    }
+    return true;
+  }
+
+  // replace count pixels by their indices; all colours must be in the palette
+  void index ( const std::uint8_t *pixels, std::size_t count, std::uint8_t *indices ) const
+  {
+    std::uint32_t last = 0;
+    int index = 0;
+    for( std::size_t k = 0; k < count; ++k )
+    {
+      std::uint32_t color;
+      std::memcpy( &color, pixels + 4*k, 4 );
+      if( (k == 0) || (color != last) )
+        index = find( color );
+      indices[ k ] = std::uint8_t( index );
+      last = color;
+    }
+  }
+
+private:
+  std::array< std::uint32_t, capacity > colors_;
+  std::array< std::int16_t, slots > slots_;
+  int size_ = 0;
+};
+
+#endif // #ifndef PALETTE_HH
@@ -96,11 +96,22 @@ namespace png
     {
       info_t info( get_png() );
       png_read_info( get_png(), info.get_info() );
+
+      // palette images (e.g., saved drawings) are expanded to RGB(A)
+      if( png_get_color_type( get_png(), info.get_info() ) == PNG_COLOR_TYPE_PALETTE )
+      {
+        png_set_palette_to_rgb( get_png() );
+        if( png_get_valid( get_png(), info.get_info(), PNG_INFO_tRNS ) )
+          png_set_tRNS_to_alpha( get_png() );
+        png_read_update_info( get_png(), info.get_info() );
+      }
       return info;
     }
 
     void read_image ( byte_t **rows ) { png_read_image( get_png(), rows ); }
 
+    void read_rows ( byte_t **rows, uint32_t count ) { png_read_rows( get_png(), rows, nullptr, count ); }
+
     std::unique_ptr< byte_t[] > read_image ( std::size_t pitch, std::size_t height, bool flip = false )
     {
       std::unique_ptr< byte_t[] > image( new byte_t[ pitch * height ] );
@@ -149,6 +160,23 @@ namespace png
       return info;
     }
 
+    // palette of count RGBA colours (byte order R, G, B, A) for color_type_t::palette
+    void set_palette ( info_t &info, const byte_t *colors, int count )
+    {
+      std::array< png_color, 256 > palette;
+      std::array< byte_t, 256 > alpha;
+      bool opaque = true;
+      for( int i = 0; i < count; ++i )
+      {
+        palette[ i ] = png_color{ colors[ 4*i ], colors[ 4*i+1 ], colors[ 4*i+2 ] };
+        alpha[ i ] = colors[ 4*i+3 ];
+        opaque = opaque && (alpha[ i ] == 255);
+      }
+      png_set_PLTE( get_png(), info.get_info(), palette.data(), count );
+      if( !opaque )
+        png_set_tRNS( get_png(), info.get_info(), alpha.data(), count, nullptr );
+    }
+
     void write_info ( info_t info )
     {
       assert( info.get_png() == get_png() );
@@ -162,6 +190,8 @@ namespace png
 
     void write_image ( byte_t **rows ) { png_write_image( get_png(), rows ); }
 
+    void write_rows ( byte_t **rows, uint32_t count ) { png_write_rows( get_png(), rows, count ); }
+
     void write_image ( byte_t *image, std::size_t pitch, std::size_t height, bool flip = false )
     {
       std::unique_ptr< byte_t *[] > rows( new byte_t *[ height ] );
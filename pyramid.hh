@@ -0,0 +1,198 @@
+#ifndef PYRAMID_HH
+#define PYRAMID_HH
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#include <SDL.h>
+
+#include "image.hh"
+#include "rect.hh"
+
+
+// Pyramid
+// -------
+//
+// Downsampled copies of an image, each half the size of the one before, down
+// to a level fitting into the view. Zoomed out views sample the level closest
+// to their resolution, so they never touch more tiles than a view at 1:1.
+// Each pixel of a level is the average of 2x2 pixels of the level before;
+// only the damaged parts are recomputed.
+
+class Pyramid
+{
+  Image &image_;
+  std::vector< Image > levels_;   // levels 1, 2, ...
+
+  // the tile of src covering all of tile k of the next level, if its 2x2
+  // source tiles are one shared uniform tile
+  static Image::SharedTile uniform ( const Image &src, const Image &dst, int k )
+  {
+    const SDL_Rect rect = dst.tileRect( k );
+    const int i = 2*rect.x / Image::tileSize, j = 2*rect.y / Image::tileSize;
+    if( (i+1 >= src.tilesX()) || (j+1 >= src.tilesY()) || (rect.w < Image::tileSize) || (rect.h < Image::tileSize) )
+      return nullptr;
+    const Image::SharedTile tile = src.tile( j*src.tilesX() + i );
+    for( int n : { 1, src.tilesX(), src.tilesX()+1 } )
+    {
+      if( src.tile( j*src.tilesX() + i + n ) != tile )
+        return nullptr;
+    }
+    return (tile->uniform() ? tile : nullptr);
+  }
+
+  // recompute rect of level l from level l-1
+  void downsample ( int l, const SDL_Rect &rect )
+  {
+    const Image &src = level( l-1 );
+    Image &dst = level( l );
+
+    // uniform areas (e.g., a blank canvas) share the source tile
+    const int i0 = rect.x / Image::tileSize, i1 = (rect.x + rect.w - 1) / Image::tileSize;
+    const int j0 = rect.y / Image::tileSize, j1 = (rect.y + rect.h - 1) / Image::tileSize;
+    for( int j = j0; j <= j1; ++j )
+    {
+      for( int i = i0; i <= i1; ++i )
+      {
+        const int k = j*dst.tilesX() + i;
+        SDL_Rect part;
+        intersect( rect, dst.tileRect( k ), part );
+        if( const Image::SharedTile tile = uniform( src, dst, k ) )
+        {
+          dst.setTile( k, tile );
+          continue;
+        }
+
+        std::uint8_t row0[ 4*2*Image::tileSize ], row1[ 4*2*Image::tileSize ];
+        dst.modifyTiles( part, [ &src, &row0, &row1 ] ( std::uint8_t *out, int pitch, const SDL_Rect &part ) {
+            // the last column and row of an odd sized level are duplicated
+            const int x0 = 2*part.x, w = std::min( 2*part.w, src.width() - x0 );
+            for( int y = 0; y < part.h; ++y, out += pitch )
+            {
+              const int y0 = 2*(part.y + y), y1 = std::min( y0 + 1, src.height() - 1 );
+              src.read( SDL_Rect{ x0, y0, w, 1 }, row0, 0 );
+              src.read( SDL_Rect{ x0, y1, w, 1 }, row1, 0 );
+              for( int c = 4*w; c < 4*2*part.w; ++c )
+              {
+                row0[ c ] = row0[ c-4 ];
+                row1[ c ] = row1[ c-4 ];
+              }
+              for( int c = 0; c < 4*part.w; ++c )
+              {
+                const int k = 8*(c / 4) + c % 4;
+                out[ c ] = std::uint8_t( (row0[ k ] + row0[ k+4 ] + row1[ k ] + row1[ k+4 ] + 2) / 4 );
+              }
+            }
+          } );
+      }
+    }
+  }
+
+public:
+  // add levels until the image fits into width x height
+  Pyramid ( Image &image, int width, int height )
+    : image_( image )
+  {
+    for( int w = image.width(), h = image.height(); (w > width) || (h > height); )
+    {
+      w = (w + 1) / 2;
+      h = (h + 1) / 2;
+      levels_.emplace_back( w, h, 255, 255, 255 );
+    }
+    update( image.rect() );
+  }
+
+  // number of levels, including the image itself as level 0
+  int levels () const { return 1 + int( levels_.size() ); }
+
+  const Image &level ( int l ) const { return (l == 0 ? image_ : levels_[ l-1 ]); }
+  Image &level ( int l ) { return (l == 0 ? image_ : levels_[ l-1 ]); }
+
+  // level to be sampled at given zoom, i.e., the smallest one at least as
+  // large as the view
+  int levelAt ( float zoom ) const
+  {
+    const int l = int( std::floor( std::log2( 1.0f / zoom ) ) );
+    return std::min( std::max( l, 0 ), levels() - 1 );
+  }
+
+  // propagate a change of the image; large changes (e.g., loading) are
+  // propagated band by band, trimming in between
+  void update ( SDL_Rect rect )
+  {
+    for( int l = 1; l < levels(); ++l )
+    {
+      const int x1 = (rect.x + rect.w + 1) / 2, y1 = (rect.y + rect.h + 1) / 2;
+      rect.x /= 2;
+      rect.y /= 2;
+      rect.w = x1 - rect.x;
+      rect.h = y1 - rect.y;
+      if( !intersect( rect, level( l ).rect(), rect ) )
+        return;
+
+      for( int y = rect.y; y < rect.y + rect.h; )
+      {
+        const int next = std::min( (y / Image::tileSize + 1) * Image::tileSize, rect.y + rect.h );
+        downsample( l, SDL_Rect{ rect.x, y, rect.w, next - y } );
+        if( rect.h > Image::tileSize )
+        {
+          level( l-1 ).trim();
+          level( l ).trim();
+        }
+        y = next;
+      }
+    }
+  }
+
+  // propagate filling the image uniformly
+  void fill ( Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255 )
+  {
+    for( Image &level : levels_ )
+      level.fill( r, g, b, a );
+  }
+
+  // nearest neighbour sampling of the view showing the image from (x, y) on
+  // at given zoom into rect of the view
+  void render ( float x, float y, float zoom, const SDL_Rect &rect, std::uint8_t *dst, int pitch ) const
+  {
+    const int l = levelAt( zoom );
+    const Image &image = level( l );
+    const float scale = zoom * float( 1 << l ), x0 = x / float( 1 << l ), y0 = y / float( 1 << l );
+
+    std::vector< int > columns( rect.w );
+    for( int i = 0; i < rect.w; ++i )
+      columns[ i ] = std::min( std::max( int( std::floor( x0 + (float( rect.x + i ) + 0.5f) / scale ) ), 0 ), image.width() - 1 );
+
+    for( int j = 0; j < rect.h; ++j, dst += pitch )
+    {
+      const int row = std::min( std::max( int( std::floor( y0 + (float( rect.y + j ) + 0.5f) / scale ) ), 0 ), image.height() - 1 );
+      const std::uint8_t *src = nullptr;
+      int tile = -1;
+      for( int i = 0; i < rect.w; ++i )
+      {
+        if( columns[ i ] / Image::tileSize != tile )
+        {
+          tile = columns[ i ] / Image::tileSize;
+          src = image.pixel( tile*Image::tileSize, row );
+        }
+        std::memcpy( dst + 4*i, src + 4*(columns[ i ] % Image::tileSize), 4 );
+      }
+    }
+  }
+
+  // exchange the levels with those of another image of the same size
+  void swap ( std::vector< Image > &levels ) { levels_.swap( levels ); }
+
+  // trim all levels (see Image::trim)
+  void trim ()
+  {
+    for( int l = 0; l < levels(); ++l )
+      level( l ).trim();
+  }
+};
+
+#endif // #ifndef PYRAMID_HH
@@ -0,0 +1,56 @@
+#ifndef RECT_HH
+#define RECT_HH
+
+#include <algorithm>
+
+#include <SDL.h>
+
+
+// intersect
+// ---------
+
+inline bool intersect ( const SDL_Rect &a, const SDL_Rect &b, SDL_Rect &result )
+{
+  const int x0 = std::max( a.x, b.x ), x1 = std::min( a.x + a.w, b.x + b.w );
+  const int y0 = std::max( a.y, b.y ), y1 = std::min( a.y + a.h, b.y + b.h );
+  result.x = x0;
+  result.y = y0;
+  result.w = std::max( x1 - x0, 0 );
+  result.h = std::max( y1 - y0, 0 );
+  return (result.w > 0) && (result.h > 0);
+}
+
+
+
+// unite
+// -----
+
+inline void unite ( SDL_Rect &a, const SDL_Rect &b )
+{
+  if( (b.w <= 0) || (b.h <= 0) )
+    return;
+  if( (a.w <= 0) || (a.h <= 0) )
+  {
+    a = b;
+    return;
+  }
+  const int x0 = std::min( a.x, b.x ), x1 = std::max( a.x + a.w, b.x + b.w );
+  const int y0 = std::min( a.y, b.y ), y1 = std::max( a.y + a.h, b.y + b.h );
+  a.x = x0;
+  a.y = y0;
+  a.w = x1 - x0;
+  a.h = y1 - y0;
+}
+
+
+
+// touches
+// -------
+
+// do the rectangles overlap or share an edge?
+inline bool touches ( const SDL_Rect &a, const SDL_Rect &b )
+{
+  return (a.x <= b.x + b.w) && (b.x <= a.x + a.w) && (a.y <= b.y + b.h) && (b.y <= a.y + a.h);
+}
+
+#endif // #ifndef RECT_HH
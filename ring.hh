@@ -0,0 +1,53 @@
+#ifndef RING_HH
+#define RING_HH
+
+#include <cstddef>
+
+#include <array>
+#include <atomic>
+
+
+// RingBuffer
+// ----------
+//
+// Lock-free queue of at most n-1 elements between exactly one producer thread
+// (push) and one consumer thread (pop). n must be a power of two. Each side
+// only writes its own index, so neither ever waits for the other.
+
+template< class T, std::size_t n = 1024 >
+class RingBuffer
+{
+  static_assert( (n & (n-1)) == 0, "Size of ring buffer must be a power of two" );
+
+public:
+  // returns false if the buffer is full
+  bool push ( const T &value )
+  {
+    const std::size_t tail = tail_.load( std::memory_order_relaxed );
+    if( ((tail + 1) & (n-1)) == head_.load( std::memory_order_acquire ) )
+      return false;
+    values_[ tail ] = value;
+    tail_.store( (tail + 1) & (n-1), std::memory_order_release );
+    return true;
+  }
+
+  // returns false if the buffer is empty
+  bool pop ( T &value )
+  {
+    const std::size_t head = head_.load( std::memory_order_relaxed );
+    if( head == tail_.load( std::memory_order_acquire ) )
+      return false;
+    value = values_[ head ];
+    head_.store( (head + 1) & (n-1), std::memory_order_release );
+    return true;
+  }
+
+  bool empty () const { return (head_.load( std::memory_order_acquire ) == tail_.load( std::memory_order_acquire )); }
+
+private:
+  std::array< T, n > values_;
+  alignas( 64 ) std::atomic< std::size_t > head_{ 0 };
+  alignas( 64 ) std::atomic< std::size_t > tail_{ 0 };
+};
+
+#endif // #ifndef RING_HH
@@ -0,0 +1,161 @@
+#ifndef RLE_HH
+#define RLE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <stdexcept>
+#include <vector>
+
+#include "palette.hh"
+
+
+// rle
+// ---
+//
+// Run-length encoding of 32-bit pixels. Each run is stored as a 16-bit count
+// followed by the pixel. Drawings consist mostly of large uniform areas, so
+// typical tiles shrink to a few bytes. Pixels with too many runs (e.g., along
+// anti-aliased edges) but at most 256 colours are stored as a palette
+// followed by an index byte per pixel. Data that does not compress at all is
+// stored verbatim, so encoding never costs more than one byte.
+
+namespace rle
+{
+
+  enum Format : std::uint8_t { raw = 0, runs = 1, indexed = 2 };
+
+  inline std::vector< std::uint8_t > encodeRuns ( const std::uint8_t *pixels, std::size_t count )
+  {
+    std::vector< std::uint8_t > data( 1, runs );
+    for( std::size_t k = 0; k < count; )
+    {
+      const std::uint8_t *pixel = pixels + 4*k;
+      std::size_t n = 1;
+      while( (k + n < count) && (n < 0xffff) && (std::memcmp( pixel, pixels + 4*(k+n), 4 ) == 0) )
+        ++n;
+
+      if( data.size() + 6 > 4*count )
+      {
+        data.assign( 1, raw );
+        data.insert( data.end(), pixels, pixels + 4*count );
+        return data;
+      }
+
+      data.push_back( std::uint8_t( n ) );
+      data.push_back( std::uint8_t( n >> 8 ) );
+      data.insert( data.end(), pixel, pixel + 4 );
+      k += n;
+    }
+    return data;
+  }
+
+  // format byte, number of colours minus one, colours, indices
+  inline bool encodeIndexed ( const std::uint8_t *pixels, std::size_t count, std::vector< std::uint8_t > &data )
+  {
+    Palette palette;
+    if( !palette.add( pixels, count ) )
+      return false;
+
+    data.resize( 2 + 4*palette.size() + count );
+    data[ 0 ] = indexed;
+    data[ 1 ] = std::uint8_t( palette.size() - 1 );
+    for( int i = 0; i < palette.size(); ++i )
+    {
+      const std::uint32_t color = palette[ i ];
+      std::memcpy( data.data() + 2 + 4*i, &color, 4 );
+    }
+    palette.index( pixels, count, data.data() + 2 + 4*palette.size() );
+    return true;
+  }
+
+  // the smaller of the run-length and indexed encodings
+  inline std::vector< std::uint8_t > encode ( const std::uint8_t *pixels, std::size_t count )
+  {
+    std::vector< std::uint8_t > data = encodeRuns( pixels, count );
+    std::vector< std::uint8_t > palette;
+    if( (data.size() > 2 + 4 + count) && encodeIndexed( pixels, count, palette ) && (palette.size() < data.size()) )
+      return palette;
+    return data;
+  }
+
+  inline void decode ( const std::vector< std::uint8_t > &data, std::uint8_t *pixels, std::size_t count )
+  {
+    if( data.empty() )
+      throw std::invalid_argument( "Empty run-length encoded data" );
+
+    if( data[ 0 ] == raw )
+    {
+      if( data.size() != 4*count + 1 )
+        throw std::invalid_argument( "Invalid size of raw data" );
+      std::memcpy( pixels, data.data() + 1, 4*count );
+      return;
+    }
+
+    if( data[ 0 ] == indexed )
+    {
+      const std::size_t colors = (data.size() >= 2 ? std::size_t( data[ 1 ] ) + 1 : 0);
+      if( (colors == 0) || (data.size() != 2 + 4*colors + count) )
+        throw std::invalid_argument( "Invalid size of indexed data" );
+      const std::uint8_t *palette = data.data() + 2, *indices = palette + 4*colors;
+      for( std::size_t k = 0; k < count; ++k )
+      {
+        if( indices[ k ] >= colors )
+          throw std::invalid_argument( "Invalid palette index" );
+        std::memcpy( pixels + 4*k, palette + 4*indices[ k ], 4 );
+      }
+      return;
+    }
+
+    std::size_t k = 0;
+    for( std::size_t pos = 1; pos + 6 <= data.size(); pos += 6 )
+    {
+      const std::size_t n = std::size_t( data[ pos ] ) | (std::size_t( data[ pos+1 ] ) << 8);
+      if( k + n > count )
+        throw std::invalid_argument( "Run-length encoded data exceeds pixel count" );
+      for( std::size_t i = 0; i < n; ++i, ++k )
+        std::memcpy( pixels + 4*k, data.data() + pos + 2, 4 );
+    }
+    if( k != count )
+      throw std::invalid_argument( "Run-length encoded data does not match pixel count" );
+  }
+
+  // add the colours of encoded pixels to a palette without decoding them;
+  // returns false if they do not fit
+  inline bool collect ( const std::vector< std::uint8_t > &data, Palette &palette )
+  {
+    if( data.empty() )
+      throw std::invalid_argument( "Empty run-length encoded data" );
+
+    std::uint32_t color;
+    switch( data[ 0 ] )
+    {
+    case raw:
+      return palette.add( data.data() + 1, (data.size() - 1) / 4 );
+
+    case indexed:
+      if( data.size() < 2 )
+        throw std::invalid_argument( "Invalid size of indexed data" );
+      for( std::size_t i = 0; i <= data[ 1 ]; ++i )
+      {
+        std::memcpy( &color, data.data() + 2 + 4*i, 4 );
+        if( palette.add( color ) < 0 )
+          return false;
+      }
+      return true;
+
+    default:
+      for( std::size_t pos = 1; pos + 6 <= data.size(); pos += 6 )
+      {
+        std::memcpy( &color, data.data() + pos + 2, 4 );
+        if( palette.add( color ) < 0 )
+          return false;
+      }
+      return true;
+    }
+  }
+
+} // namespace rle
+
+#endif // #ifndef RLE_HH
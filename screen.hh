@@ -1,24 +1,147 @@
 #ifndef SCREEN_HH
 #define SCREEN_HH
 
-#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <vector>
 
 #include <SDL.h>
 
+#include "evdev.hh"
+#include "hud.hh"
+#include "rect.hh"
+#include "stats.hh"
+#include "tasks.hh"
+#include "trace.hh"
+
+// Pointer
+// -------
+//
+// Identifies the mouse or a single finger on a touch device
+
+struct Pointer
+{
+  static constexpr SDL_TouchID mouse = -1;
+
+  SDL_TouchID touch = mouse;
+  SDL_FingerID finger = 0;
+
+  bool operator== ( const Pointer &other ) const { return (touch == other.touch) && (finger == other.finger); }
+  bool operator!= ( const Pointer &other ) const { return !(*this == other); }
+};
+
+
+
 // Touchable
 // ---------
 
 struct Touchable
 {
   virtual ~Touchable () {}
-  virtual bool down ( int x, int y ) { return false; }
-  virtual bool up ( int x, int y ) { return false; }
-  virtual bool move ( int x, int y, int dx, int dy ) { return false; }
+  virtual bool down ( float x, float y ) { return false; }
+  virtual bool up ( float x, float y ) { return false; }
+  virtual bool move ( float x, float y, float dx, float dy ) { return false; }
+
+  // touchables tracking multiple pointers override these
+  virtual bool down ( const Pointer &pointer, float x, float y ) { return down( x, y ); }
+  virtual bool up ( const Pointer &pointer, float x, float y ) { return up( x, y ); }
+  virtual bool move ( const Pointer &pointer, float x, float y, float dx, float dy ) { return move( x, y, dx, dy ); }
+};
+
+
+
+// Flushable
+// ---------
+//
+// Objects buffering their changes are flushed to their textures once per
+// frame, right before the screen is redrawn.
+
+struct Flushable
+{
+  virtual ~Flushable () {}
+  virtual void flush () = 0;
+};
+
+
+
+// FrameStatistics
+// ---------------
+
+struct FrameStatistics
+{
+  unsigned int targetSwitches = 0;
+  unsigned int blits = 0;
+  unsigned int copies = 0;
+  unsigned int batches = 0;     // submissions of copies, one per texture
+  unsigned long damagedArea = 0;
+  unsigned int events = 0;      // events dispatched (after coalescing)
+  unsigned int tasks = 0;       // tasks run (e.g., for the web server)
+
+  // measured only while the HUD is shown (in ms)
+  double paintTime = 0.0;       // flushing, i.e., painting and uploading textures
+  double presentTime = 0.0;     // SDL_RenderPresent
+};
+
+inline std::ostream &operator<< ( std::ostream &out, const FrameStatistics &statistics )
+{
+  out << "targetSwitches: " << statistics.targetSwitches << std::endl;
+  out << "blits: " << statistics.blits << std::endl;
+  out << "copies: " << statistics.copies << std::endl;
+  out << "batches: " << statistics.batches << std::endl;
+  out << "damagedArea: " << statistics.damagedArea << std::endl;
+  out << "events: " << statistics.events << std::endl;
+  out << "tasks: " << statistics.tasks << std::endl;
+  out << "paintTime: " << statistics.paintTime << std::endl;
+  out << "presentTime: " << statistics.presentTime << std::endl;
+  return out;
+}
+
+
+
+// LoopStatistics
+// --------------
+
+struct LoopStatistics
+{
+  double wakeupsPerSecond = 0.0;
+  double busy = 0.0;          // fraction of time the event loop did not wait
+  double cpu = 0.0;           // CPU time of the process per wall-clock time
+  bool lowLatency = false;    // mode the latency was measured in
+  Samples<> latency;          // time from input event to present (in ms)
+  std::size_t tasksQueued = 0;    // most tasks queued at once
+  std::size_t tasksRejected = 0;  // tasks rejected, because the queue was full
+  std::size_t tasksPending = 0;   // tasks waiting for the budget
+  std::size_t tasksCoalesced = 0; // tasks merged into a pending duplicate
+  Samples<> taskLatency;          // time from posting a task to running it (in ms)
 };
 
+inline std::ostream &operator<< ( std::ostream &out, const LoopStatistics &statistics )
+{
+  out << "wakeupsPerSecond: " << statistics.wakeupsPerSecond << std::endl;
+  out << "busy: " << statistics.busy << std::endl;
+  out << "cpu: " << statistics.cpu << std::endl;
+  out << "lowLatency: " << statistics.lowLatency << std::endl;
+  out << "latency50: " << statistics.latency.percentile( 50 ) << std::endl;
+  out << "latency90: " << statistics.latency.percentile( 90 ) << std::endl;
+  out << "latency99: " << statistics.latency.percentile( 99 ) << std::endl;
+  out << "tasksQueued: " << statistics.tasksQueued << std::endl;
+  out << "tasksRejected: " << statistics.tasksRejected << std::endl;
+  out << "tasksPending: " << statistics.tasksPending << std::endl;
+  out << "tasksCoalesced: " << statistics.tasksCoalesced << std::endl;
+  out << "taskLatency50: " << statistics.taskLatency.percentile( 50 ) << std::endl;
+  out << "taskLatency90: " << statistics.taskLatency.percentile( 90 ) << std::endl;
+  out << "taskLatency99: " << statistics.taskLatency.percentile( 99 ) << std::endl;
+  return out;
+}
+
 
 
 // Screen
@@ -28,57 +151,651 @@ class Screen
 {
   friend class Texture;
 
-  struct Lambda
+  struct Tile
   {
-    virtual ~Lambda () = default;
-    virtual bool operator() () = 0;
+    SDL_Texture *texture = nullptr;
+    Touchable *touchable = nullptr;
+    SDL_Rect rect = SDL_Rect{ 0, 0, 0, 0 };
   };
 
-  template< class F >
-  struct LambdaWrapper
-    : public Lambda
+  // maximal rectangle of tiles showing a contiguous part of one texture
+  struct Region
   {
-    explicit LambdaWrapper ( F f )
-      : f_( std::move( f ) )
-    {}
+    SDL_Texture *texture;
+    SDL_Rect src, dst;
+  };
+
+  SDL_Window *window_ = nullptr;
+  SDL_Renderer *renderer_ = nullptr;
+  SDL_Texture *composite_ = nullptr;
+
+  // the grid of tiles is centered on the display, in its native resolution
+  int columns_ = 16, rows_ = 9, tileSize_ = 120;
+  int x0_ = 0, y0_ = 0;
+  float pointScale_ = 1.0f;   // pixels per window coordinate (e.g., for HiDPI)
+
+  std::vector< Tile > tiles_;
+  std::vector< Region > regions_;
+  std::vector< Region > copies_;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  std::vector< SDL_Vertex > vertices_;
+  std::vector< int > indices_;
+#endif // #if SDL_VERSION_ATLEAST(2, 0, 18)
+  std::vector< Flushable * > flushables_;
+
+  mutable std::vector< SDL_Rect > damage_;
 
-    bool operator() () override { return f_(); }
+  mutable std::vector< Flushable * > pending_;
+  mutable SDL_Texture *renderTarget_ = nullptr;
 
-  private:
-    F f_;
+  mutable FrameStatistics frame_;
+  FrameStatistics lastFrame_;
+
+  // tasks posted from other threads; only the wake-up (taskEvent_) is queued.
+  // They are handed to the scheduler, which runs them after the input within
+  // taskBudget per frame interval (starting at taskPeriod_).
+  TaskQueue<> tasks_;
+  Uint32 taskEvent_ = -1;
+  TaskScheduler scheduler_;
+  Uint64 taskPeriod_ = 0, taskTicks_ = 0;
+
+  // touches read by a TouchReader bypass SDL's event queue; only the wake-up
+  // (touchEvent_) is queued
+  TouchReader *touchReader_ = nullptr;
+  Uint32 touchEvent_ = -1;
+  std::vector< SDL_Event > touches_;
+
+  // touchable each pointer pressed last touched, with its position there (in
+  // the touchable's coordinates)
+  struct Contact
+  {
+    Pointer pointer;
+    Touchable *touchable;
+    float x, y;
   };
+  std::vector< Contact > contacts_;
 
-  struct Tile
+  // input is recorded into trace_; a trace being replayed (replay_) is the
+  // only input besides SDL's event queue
+  Trace *trace_ = nullptr;
+  TraceReader *replay_ = nullptr;
+  std::vector< SDL_Event > replayed_;
+  TraceStatistics replayStatistics_;
+
+  bool headless_ = false;
+  Uint64 frameTicks_ = 0, lastPresent_ = 0, frameWaitTicks_ = 0;
+  Uint32 firstInput_ = 0;
+
+  LoopStatistics loop_;
+
+  Hud hud_;
+  Samples< 256 > hudFrames_;   // busy time of the recent frames (in ms)
+  Uint64 loopStart_ = 0, waitTicks_ = 0;
+  std::clock_t loopClock_ = 0;
+  unsigned int wakeups_ = 0;
+
+public:
+  // maximum distance (in pixels) of motion events merged into one
+  float coalesceDistance = 2.0f;
+
+  // present input as soon as it is handled instead of draining the event
+  // queue and waiting for the next frame interval
+  bool lowLatency = false;
+
+  // time (in ms) per frame interval for running tasks (see pushTask); a task
+  // is only started within the budget, but always finished
+  double taskBudget = 4.0;
+
+  // overlay performance numbers on each frame (toggled by F1); while it is
+  // off, nothing is measured beyond a few counters
+  bool hud = false;
+
+private:
+  const Tile &tile ( int i, int j ) const { return tiles_[ j*columns_ + i ]; }
+  Tile &tile ( int i, int j ) { return tiles_[ j*columns_ + i ]; }
+
+  // map window coordinates (or, for touches, normalized coordinates) into the grid
+  void toGrid ( float &x, float &y ) const { x = x*pointScale_ - x0_; y = y*pointScale_ - y0_; }
+  void toGrid ( const SDL_TouchFingerEvent &event, float &x, float &y ) const
   {
-    SDL_Texture *texture = nullptr;
-    Touchable *touchable = nullptr;
-    SDL_Rect rect;
+    x = event.x * (width() + 2*x0_) - x0_;
+    y = event.y * (height() + 2*y0_) - y0_;
+  }
+
+  // find the touchable at screen position (x, y) and map (x, y) into its coordinates
+  Touchable *touchable ( float &x, float &y )
+  {
+    const int i = std::min( std::max( int( std::floor( x ) ) / tileSize_, 0 ), columns_-1 );
+    const int j = std::min( std::max( int( std::floor( y ) ) / tileSize_, 0 ), rows_-1 );
+    x += tile( i, j ).rect.x - i*tileSize_;
+    y += tile( i, j ).rect.y - j*tileSize_;
+    return tile( i, j ).touchable;
+  }
 
-    Tile ()
+  void updateRegions ()
+  {
+    // merge horizontally adjacent tiles into runs
+    std::vector< Region > runs;
+    for( int j = 0; j < rows_; ++j )
     {
-      rect.y = rect.x = 0;
-      rect.h = rect.w = 120;
+      for( int i = 0; i < columns_; ++i )
+      {
+        const Tile &t = tile( i, j );
+        if( !t.texture )
+          continue;
+
+        Region *run = (runs.empty() ? nullptr : &runs.back());
+        if( run && (run->texture == t.texture) && (run->dst.y == j*tileSize_) && (run->dst.x + run->dst.w == i*tileSize_)
+            && (run->src.y == t.rect.y) && (run->src.x + run->src.w == t.rect.x) )
+        {
+          run->src.w += tileSize_;
+          run->dst.w += tileSize_;
+        }
+        else
+          runs.push_back( Region{ t.texture, t.rect, SDL_Rect{ i*tileSize_, j*tileSize_, tileSize_, tileSize_ } } );
+      }
     }
-  };
 
-  SDL_Window *window_ = nullptr;
-  SDL_Renderer *renderer_ = nullptr;
+    // merge vertically adjacent runs of equal extent into regions
+    regions_.clear();
+    for( const Region &run : runs )
+    {
+      auto pos = std::find_if( regions_.begin(), regions_.end(), [ &run ] ( const Region &r ) {
+          return (r.texture == run.texture) && (r.dst.x == run.dst.x) && (r.dst.w == run.dst.w) && (r.dst.y + r.dst.h == run.dst.y)
+                 && (r.src.x == run.src.x) && (r.src.w == run.src.w) && (r.src.y + r.src.h == run.src.y);
+        } );
+      if( pos != regions_.end() )
+      {
+        pos->src.h += tileSize_;
+        pos->dst.h += tileSize_;
+      }
+      else
+        regions_.push_back( run );
+    }
+  }
+
+  // the touchable under the pointer at (x, y), translated into its coordinates;
+  // a pointer leaving a touchable is released there, where it was last seen,
+  // so no touchable waits for a release that goes elsewhere
+  Touchable *enter ( const Pointer &pointer, float &x, float &y, bool &changed )
+  {
+    Touchable *touchable = this->touchable( x, y );
+    auto pos = std::find_if( contacts_.begin(), contacts_.end(), [ &pointer ] ( const Contact &c ) { return (c.pointer == pointer); } );
+    if( (pos != contacts_.end()) && (pos->touchable != touchable) )
+    {
+      const Contact contact = *pos;
+      contacts_.erase( pos );
+      changed |= contact.touchable->up( pointer, contact.x, contact.y );
+      pos = contacts_.end();
+    }
+    if( pos != contacts_.end() )
+    {
+      pos->x = x;
+      pos->y = y;
+    }
+    else if( touchable )
+      contacts_.push_back( Contact{ pointer, touchable, x, y } );
+    return touchable;
+  }
+
+  // the pointer is released
+  void leave ( const Pointer &pointer )
+  {
+    contacts_.erase( std::remove_if( contacts_.begin(), contacts_.end(), [ &pointer ] ( const Contact &c ) { return (c.pointer == pointer); } ), contacts_.end() );
+  }
+
+  static Pointer pointer ( const SDL_Event &event )
+  {
+    Pointer pointer;
+    switch( event.type )
+    {
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+      pointer.finger = event.button.which;
+      break;
+
+    case SDL_MOUSEMOTION:
+      pointer.finger = event.motion.which;
+      break;
+
+    case SDL_FINGERDOWN:
+    case SDL_FINGERUP:
+    case SDL_FINGERMOTION:
+      pointer.touch = event.tfinger.touchId;
+      pointer.finger = event.tfinger.fingerId;
+      break;
+    }
+    return pointer;
+  }
+
+  // with a touch reader, SDL's own touch events are duplicates
+  bool duplicate ( const SDL_Event &event ) const
+  {
+    if( event.type == touchEvent_ )
+      return true;
+    return touchReader_ && ((event.type == SDL_FINGERDOWN) || (event.type == SDL_FINGERUP) || (event.type == SDL_FINGERMOTION))
+           && (event.tfinger.touchId != TouchReader::touchId);
+  }
+
+  // handle a single event, returns false if the application shall quit
+  bool dispatch ( const SDL_Event &event, bool &redraw )
+  {
+    if( event.type == taskEvent_ )
+    {
+      tasks_.drain( [ this ] ( Task &&task ) { scheduler_.add( std::move( task ) ); } );
+      return true;
+    }
+
+    if( duplicate( event ) )
+      return true;
+    ++frame_.events;
+
+    bool changed = false;
+    switch( event.type )
+    {
+    case SDL_QUIT:
+      return false;
+
+    case SDL_MOUSEBUTTONDOWN:
+      // touches are handled as such, ignore the emulated mouse
+      if( (event.button.button == SDL_BUTTON_LEFT) && (event.button.which != SDL_TOUCH_MOUSEID) )
+      {
+        float x = event.button.x, y = event.button.y;
+        toGrid( x, y );
+        Touchable *touchable = enter( pointer( event ), x, y, changed );
+        if( touchable )
+          changed |= touchable->down( pointer( event ), x, y );
+      }
+      break;
+
+    case SDL_MOUSEBUTTONUP:
+      if( (event.button.button == SDL_BUTTON_LEFT) && (event.button.which != SDL_TOUCH_MOUSEID) )
+      {
+        float x = event.button.x, y = event.button.y;
+        toGrid( x, y );
+        Touchable *touchable = enter( pointer( event ), x, y, changed );
+        if( touchable )
+          changed |= touchable->up( pointer( event ), x, y );
+        leave( pointer( event ) );
+      }
+      break;
+
+    case SDL_MOUSEMOTION:
+      if( (event.motion.state & SDL_BUTTON( SDL_BUTTON_LEFT )) && (event.motion.which != SDL_TOUCH_MOUSEID) )
+      {
+        float x = event.motion.x, y = event.motion.y;
+        toGrid( x, y );
+        Touchable *touchable = enter( pointer( event ), x, y, changed );
+        if( touchable )
+          changed |= touchable->move( pointer( event ), x, y, event.motion.xrel * pointScale_, event.motion.yrel * pointScale_ );
+      }
+      break;
+
+    case SDL_FINGERDOWN:
+      {
+        float x, y;
+        toGrid( event.tfinger, x, y );
+        Touchable *touchable = enter( pointer( event ), x, y, changed );
+        if( touchable )
+          changed |= touchable->down( pointer( event ), x, y );
+      }
+      break;
+
+    case SDL_FINGERUP:
+      {
+        float x, y;
+        toGrid( event.tfinger, x, y );
+        Touchable *touchable = enter( pointer( event ), x, y, changed );
+        if( touchable )
+          changed |= touchable->up( pointer( event ), x, y );
+        leave( pointer( event ) );
+      }
+      break;
+
+    case SDL_FINGERMOTION:
+      {
+        float x, y;
+        toGrid( event.tfinger, x, y );
+        Touchable *touchable = enter( pointer( event ), x, y, changed );
+        if( touchable )
+          changed |= touchable->move( pointer( event ), x, y, event.tfinger.dx * (width() + 2*x0_), event.tfinger.dy * (height() + 2*y0_) );
+      }
+      break;
+
+    case SDL_KEYDOWN:
+      if( event.key.keysym.sym == SDLK_ESCAPE )
+        return false;
+      if( event.key.keysym.sym == SDLK_F1 )
+      {
+        hud = !hud;
+        redraw |= true;
+      }
+      break;
+
+    case SDL_WINDOWEVENT:
+      damage( SDL_Rect{ 0, 0, width(), height() } );
+      redraw |= true;
+      break;
+    }
+
+    // remember the oldest input that changed something, but is not presented, yet
+    if( changed && (firstInput_ == 0) )
+      firstInput_ = std::max( event.common.timestamp, Uint32( 1 ) );
+    redraw |= changed;
+    return true;
+  }
+
+  // can event b be merged into the motion event a?
+  bool mergeable ( const SDL_Event &a, const SDL_Event &b ) const
+  {
+    if( (a.type == SDL_MOUSEMOTION) && (b.type == SDL_MOUSEMOTION) )
+    {
+      if( (a.motion.which != b.motion.which) || (a.motion.state != b.motion.state) )
+        return false;
+      const float dx = (a.motion.xrel + b.motion.xrel) * pointScale_, dy = (a.motion.yrel + b.motion.yrel) * pointScale_;
+      return (dx*dx + dy*dy <= coalesceDistance*coalesceDistance);
+    }
+
+    if( (a.type == SDL_FINGERMOTION) && (b.type == SDL_FINGERMOTION) )
+    {
+      if( (a.tfinger.touchId != b.tfinger.touchId) || (a.tfinger.fingerId != b.tfinger.fingerId) )
+        return false;
+      const float dx = (a.tfinger.dx + b.tfinger.dx) * (width() + 2*x0_), dy = (a.tfinger.dy + b.tfinger.dy) * (height() + 2*y0_);
+      return (dx*dx + dy*dy <= coalesceDistance*coalesceDistance);
+    }
+
+    return false;
+  }
+
+  // merge consecutive motion events of the same pointer, as long as they stay
+  // within coalesceDistance, so the shape of strokes is preserved
+  int coalesce ( SDL_Event *events, int count ) const
+  {
+    int n = 0;
+    for( int k = 0; k < count; ++k )
+    {
+      if( (n == 0) || !mergeable( events[ n-1 ], events[ k ] ) )
+      {
+        events[ n++ ] = events[ k ];
+        continue;
+      }
+
+      SDL_Event &a = events[ n-1 ];
+      const SDL_Event &b = events[ k ];
+      if( a.type == SDL_MOUSEMOTION )
+      {
+        a.motion.x = b.motion.x;
+        a.motion.y = b.motion.y;
+        a.motion.xrel += b.motion.xrel;
+        a.motion.yrel += b.motion.yrel;
+      }
+      else
+      {
+        a.tfinger.x = b.tfinger.x;
+        a.tfinger.y = b.tfinger.y;
+        a.tfinger.dx += b.tfinger.dx;
+        a.tfinger.dy += b.tfinger.dy;
+        a.tfinger.pressure = b.tfinger.pressure;
+      }
+    }
+    return n;
+  }
+
+  // dispatch the samples of the touch reader as SDL touch events
+  void dispatchTouches ( bool &redraw )
+  {
+    touches_.clear();
+    touchReader_->drain( [ this ] ( const TouchSample &sample ) {
+        static const Uint32 types[] = { SDL_FINGERDOWN, SDL_FINGERMOTION, SDL_FINGERUP };
+        SDL_Event event;
+        SDL_memset( &event, 0, sizeof( event ) );
+        event.tfinger.type = types[ sample.type ];
+        event.tfinger.timestamp = sample.ticks;
+        event.tfinger.touchId = TouchReader::touchId;
+        event.tfinger.fingerId = sample.slot;
+        event.tfinger.x = sample.x;
+        event.tfinger.y = sample.y;
+        event.tfinger.dx = sample.dx;
+        event.tfinger.dy = sample.dy;
+        event.tfinger.pressure = 1.0f;
+        touches_.push_back( event );
+      } );
+    // no coalescing, the strokes get every sample of the sensor
+    if( trace_ )
+      record( touches_.data(), int( touches_.size() ) );
+    for( const SDL_Event &event : touches_ )
+      dispatch( event, redraw );
+  }
 
-  std::array< Tile, 16*9 > tiles_;
+  // scale the coordinates of mouse events (touches are normalized)
+  static void scaleMouse ( SDL_Event &event, float scale )
+  {
+    if( (event.type == SDL_MOUSEBUTTONDOWN) || (event.type == SDL_MOUSEBUTTONUP) )
+    {
+      event.button.x = Sint32( std::lround( event.button.x * scale ) );
+      event.button.y = Sint32( std::lround( event.button.y * scale ) );
+    }
+    else if( event.type == SDL_MOUSEMOTION )
+    {
+      event.motion.x = Sint32( std::lround( event.motion.x * scale ) );
+      event.motion.y = Sint32( std::lround( event.motion.y * scale ) );
+      event.motion.xrel = Sint32( std::lround( event.motion.xrel * scale ) );
+      event.motion.yrel = Sint32( std::lround( event.motion.yrel * scale ) );
+    }
+  }
+
+  // record input events as received, with mouse coordinates in pixels
+  void record ( const SDL_Event *events, int count )
+  {
+    for( int k = 0; k < count; ++k )
+    {
+      if( duplicate( events[ k ] ) )
+        continue;
+      SDL_Event event = events[ k ];
+      scaleMouse( event, pointScale_ );
+      trace_->record( event );
+    }
+  }
+
+  // dispatch the events of the next frame interval of the trace replayed as if
+  // they had just arrived; returns false at the end of the trace
+  bool replayFrame ( bool &redraw )
+  {
+    const Uint32 interval = Uint32( std::max( frameTicks_ * 1000 / SDL_GetPerformanceFrequency(), Uint64( 1 ) ) );
+    if( !replay_->frame( interval, replayed_ ) )
+      return false;
+
+    replayStatistics_.events += replayed_.size();
+    const Uint32 now = SDL_GetTicks();
+    for( SDL_Event &event : replayed_ )
+    {
+      event.common.timestamp = now;
+      scaleMouse( event, 1.0f / pointScale_ );
+    }
+    const int count = coalesce( replayed_.data(), int( replayed_.size() ) );
+    for( int k = 0; k < count; ++k )
+      dispatch( replayed_[ k ], redraw );
+    return true;
+  }
+
+  // copy parts of the same texture into the render target in one batch
+  void submit ( std::vector< Region >::const_iterator begin, std::vector< Region >::const_iterator end )
+  {
+    frame_.copies += end - begin;
+    ++frame_.batches;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    SDL_Texture *texture = begin->texture;
+    int w = 1, h = 1;
+    SDL_QueryTexture( texture, nullptr, nullptr, &w, &h );
+    const SDL_Color color{ 255, 255, 255, 255 };
+
+    vertices_.clear();
+    indices_.clear();
+    for( ; begin != end; ++begin )
+    {
+      const int k = vertices_.size();
+      const float x0 = begin->dst.x, y0 = begin->dst.y, x1 = x0 + begin->dst.w, y1 = y0 + begin->dst.h;
+      const float u0 = float( begin->src.x ) / w, v0 = float( begin->src.y ) / h;
+      const float u1 = float( begin->src.x + begin->src.w ) / w, v1 = float( begin->src.y + begin->src.h ) / h;
+      vertices_.push_back( SDL_Vertex{ SDL_FPoint{ x0, y0 }, color, SDL_FPoint{ u0, v0 } } );
+      vertices_.push_back( SDL_Vertex{ SDL_FPoint{ x1, y0 }, color, SDL_FPoint{ u1, v0 } } );
+      vertices_.push_back( SDL_Vertex{ SDL_FPoint{ x1, y1 }, color, SDL_FPoint{ u1, v1 } } );
+      vertices_.push_back( SDL_Vertex{ SDL_FPoint{ x0, y1 }, color, SDL_FPoint{ u0, v1 } } );
+      for( int i : { 0, 1, 2, 0, 2, 3 } )
+        indices_.push_back( k + i );
+    }
+    SDL_RenderGeometry( renderer_, texture, vertices_.data(), vertices_.size(), indices_.data(), indices_.size() );
+#else // #if SDL_VERSION_ATLEAST(2, 0, 18)
+    for( ; begin != end; ++begin )
+      SDL_RenderCopy( renderer_, begin->texture, &begin->src, &begin->dst );
+#endif // #else // #if SDL_VERSION_ATLEAST(2, 0, 18)
+  }
+
+  static double milliseconds ( Uint64 ticks ) { return 1000.0 * double( ticks ) / double( SDL_GetPerformanceFrequency() ); }
+
+  // overlay the numbers of the frame being drawn (the present time is the
+  // previous frame's) and a histogram of the recent frame times in 1 ms bins
+  void drawHud ()
+  {
+    hud_.clear();
+    const int x = x0_ + tileSize_ + 4*hud_.scale(), y = y0_ + 4*hud_.scale(), line = hud_.lineHeight();
+    char text[ 96 ];
+    std::snprintf( text, sizeof( text ), "FRAME %.1f / %.1f / %.1f MS (50/90/99%%)",
+                   hudFrames_.percentile( 50 ), hudFrames_.percentile( 90 ), hudFrames_.percentile( 99 ) );
+    hud_.text( x, y, text );
+    std::snprintf( text, sizeof( text ), "EVENTS %u  TASKS %u  BLITS %u", frame_.events, frame_.tasks, frame_.blits );
+    hud_.text( x, y + line, text );
+    std::snprintf( text, sizeof( text ), "PAINT %.2f MS  PRESENT %.2f MS", frame_.paintTime, lastFrame_.presentTime );
+    hud_.text( x, y + 2*line, text );
+    hud_.histogram( SDL_Rect{ x, y + 3*line, 32*3*hud_.scale(), 4*line }, hudFrames_, 1.0, 32 );
+    hud_.render( renderer_ );
+  }
+
+  // is there input to be presented right away?
+  bool urgent () const { return lowLatency && (firstInput_ != 0); }
+
+  // taskBudget in ticks of the performance counter
+  Uint64 budgetTicks () const { return Uint64( std::max( taskBudget, 0.0 ) * double( SDL_GetPerformanceFrequency() ) / 1000.0 ); }
+
+  // may a task be started in the current frame interval? (at least one may)
+  bool budgetLeft () const { return (taskTicks_ == 0) || (taskTicks_ < budgetTicks()); }
+
+  // run pending tasks within what is left of the budget of the current frame
+  // interval
+  void runTasks ( bool &redraw )
+  {
+    if( scheduler_.empty() )
+      return;
+    const Uint64 start = SDL_GetPerformanceCounter();
+    if( start >= taskPeriod_ + frameTicks_ )
+    {
+      taskPeriod_ = start;
+      taskTicks_ = 0;
+    }
+    if( !budgetLeft() )
+      return;
+    frame_.tasks += scheduler_.run( milliseconds( budgetTicks() - std::min( taskTicks_, budgetTicks() ) ), redraw );
+    taskTicks_ += std::max( SDL_GetPerformanceCounter() - start, Uint64( 1 ) );
+  }
+
+  void updateLoopStatistics ()
+  {
+    const Uint64 now = SDL_GetPerformanceCounter();
+    const double elapsed = double( now - loopStart_ ) / double( SDL_GetPerformanceFrequency() );
+    if( elapsed < 1.0 )
+      return;
+
+    const std::clock_t clock = std::clock();
+    loop_.wakeupsPerSecond = wakeups_ / elapsed;
+    loop_.busy = 1.0 - double( waitTicks_ ) / double( now - loopStart_ );
+    loop_.cpu = double( clock - loopClock_ ) / CLOCKS_PER_SEC / elapsed;
+
+    // latencies of different modes are not mixed
+    if( loop_.lowLatency != lowLatency )
+      loop_.latency.clear();
+    loop_.lowLatency = lowLatency;
+
+    loop_.tasksQueued = tasks_.peak();
+    loop_.tasksRejected = tasks_.rejected();
+    loop_.tasksPending = scheduler_.size();
+    loop_.tasksCoalesced = scheduler_.coalesced();
+    loop_.taskLatency = scheduler_.latency();
+    tasks_.resetPeak();
+
+    loopStart_ = now;
+    loopClock_ = clock;
+    wakeups_ = 0;
+    waitTicks_ = 0;
+  }
 
 public:
-  Uint32 lambdaEvent = -1;
+  // size of the grid in pixels
+  int width () const { return columns_*tileSize_; }
+  int height () const { return rows_*tileSize_; }
+
+  int columns () const { return columns_; }
+  int rows () const { return rows_; }
+
+  // edge length of a tile in pixels, chosen to fit the display
+  int tileSize () const { return tileSize_; }
+
+  // size of the output, i.e., the grid and the margins centering it, in pixels
+  int outputWidth () const { return width() + 2*x0_; }
+  int outputHeight () const { return height() + 2*y0_; }
+
+  // is nothing presented to a display?
+  bool headless () const { return headless_; }
+
+  // a screen without a display of width x height pixels (see Screen( Headless ))
+  struct Headless
+  {
+    int width = 1920, height = 1080;
+  };
+
+  // a grid of at least columns x rows square tiles, as large as the display
+  // allows; everything is drawn in the display's native resolution. If the
+  // environment variable KIDZ_DRAW_HEADLESS is set (to WxH or empty), the
+  // screen is headless.
+  explicit Screen ( int columns = 16, int rows = 9 )
+    : Screen( headlessEnvironment().get(), columns, rows )
+  {}
+
+  // a headless screen renders everything in software into a hidden window of
+  // SDL's offscreen (or dummy) video driver, but never presents it; the code
+  // path is the same otherwise, e.g., for benchmarks without a display or GPU
+  Screen ( Headless headless, int columns = 16, int rows = 9 )
+    : Screen( &headless, columns, rows )
+  {}
 
 private:
-  const Tile &tile ( int i, int j ) const { return tiles_[ j*16 + i ]; }
-  Tile &tile ( int i, int j ) { return tiles_[ j*16 + i ]; }
+  static std::unique_ptr< Headless > headlessEnvironment ()
+  {
+    const char *size = std::getenv( "KIDZ_DRAW_HEADLESS" );
+    if( !size )
+      return nullptr;
+    std::unique_ptr< Headless > headless( new Headless );
+    int width = 0, height = 0;
+    if( (std::sscanf( size, "%dx%d", &width, &height ) == 2) && (width > 0) && (height > 0) )
+      *headless = Headless{ width, height };
+    return headless;
+  }
 
-public:
-  static constexpr int width () { return 1920; }
-  static constexpr int height () { return 1080; }
+  // prefer the offscreen video driver, which needs no display at all
+  static const char *headlessDriver ()
+  {
+    for( int k = 0; k < SDL_GetNumVideoDrivers(); ++k )
+    {
+      if( std::strcmp( SDL_GetVideoDriver( k ), "offscreen" ) == 0 )
+        return "offscreen";
+    }
+    return "dummy";
+  }
 
-  Screen ()
+  Screen ( const Headless *headless, int columns, int rows )
+    : headless_( headless != nullptr )
   {
+    if( headless_ )
+      SDL_setenv( "SDL_VIDEODRIVER", headlessDriver(), 1 );
     if( SDL_Init( SDL_INIT_VIDEO ) != 0 )
     {
       const char *error = SDL_GetError();
@@ -87,7 +804,10 @@ public:
     }
 
     //SDL_CreateWindowAndRenderer( 0, 0, SDL_WINDOW_FULLSCREEN_DESKTOP, &window_, &renderer_ );
-    window_ = SDL_CreateWindow( "Kidz Draw", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 0, 0, SDL_WINDOW_FULLSCREEN_DESKTOP );
+    if( headless_ )
+      window_ = SDL_CreateWindow( "Kidz Draw", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, headless->width, headless->height, SDL_WINDOW_HIDDEN );
+    else
+      window_ = SDL_CreateWindow( "Kidz Draw", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 0, 0, SDL_WINDOW_FULLSCREEN_DESKTOP );
     if( !window_ )
     {
       const char *error = SDL_GetError();
@@ -96,7 +816,7 @@ public:
       exit( 1 );
     }
 
-    renderer_ = SDL_CreateRenderer( window_, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE );
+    renderer_ = SDL_CreateRenderer( window_, -1, (headless_ ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED) | SDL_RENDERER_TARGETTEXTURE );
     if( !renderer_ )
     {
       const char *error = SDL_GetError();
@@ -105,150 +825,255 @@ public:
       exit( 1 );
     }
 
-    SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "linear" );
-    SDL_RenderSetLogicalSize( renderer_, width(), height() );
+    int outputWidth = 0, outputHeight = 0, windowWidth = 0, windowHeight = 0;
+    SDL_GetRendererOutputSize( renderer_, &outputWidth, &outputHeight );
+    SDL_GetWindowSize( window_, &windowWidth, &windowHeight );
+    tileSize_ = std::max( std::min( outputWidth / columns, outputHeight / rows ), 1 );
+    columns_ = std::max( outputWidth / tileSize_, columns );
+    rows_ = std::max( outputHeight / tileSize_, rows );
+    x0_ = (outputWidth - width()) / 2;
+    y0_ = (outputHeight - height()) / 2;
+    pointScale_ = (windowWidth > 0 ? float( outputWidth ) / float( windowWidth ) : 1.0f);
+    tiles_.resize( columns_*rows_ );
+    hud_ = Hud( std::max( tileSize_ / 60, 1 ) );
+
+    // the back buffer is undefined after presenting, so we composite into a texture
+    composite_ = SDL_CreateTexture( renderer_, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_TARGET, width(), height() );
+
+    taskEvent_ = SDL_RegisterEvents( 1 );
+    const Uint32 type = taskEvent_;
+    tasks_.setNotify( [ type ] () {
+        SDL_Event event;
+        SDL_memset( &event, 0, sizeof( event ) );
+        event.type = type;
+        SDL_PushEvent( &event );
+      } );
 
-    lambdaEvent = SDL_RegisterEvents( 1 );
+    SDL_DisplayMode mode;
+    const int refreshRate = (SDL_GetCurrentDisplayMode( SDL_GetWindowDisplayIndex( window_ ), &mode ) == 0 ? mode.refresh_rate : 0);
+    frameTicks_ = SDL_GetPerformanceFrequency() / (refreshRate > 0 ? refreshRate : 60);
+
+    loopStart_ = SDL_GetPerformanceCounter();
+    loopClock_ = std::clock();
   }
 
+public:
   ~Screen ()
   {
+    tasks_.close();
+    scheduler_.clear();
+    SDL_DestroyTexture( composite_ );
     SDL_Quit();
   }
 
+  void flush ()
+  {
+    const Uint64 start = (hud ? SDL_GetPerformanceCounter() : 0);
+    for( Flushable *flushable : flushables_ )
+      flushable->flush();
+    flushPending();
+    if( hud )
+      frame_.paintTime += milliseconds( SDL_GetPerformanceCounter() - start );
+  }
+
   void draw ()
   {
+    flush();
+
+    // without any reported damage, assume everything has changed
+    if( damage_.empty() )
+      damage( SDL_Rect{ 0, 0, width(), height() } );
+
+    setRenderTarget( composite_ );
     SDL_SetRenderDrawColor( renderer_, 0, 0, 0, 255 );
-    SDL_RenderClear( renderer_ );
+    SDL_RenderFillRects( renderer_, damage_.data(), int( damage_.size() ) );
 
-    SDL_Rect rect;
-    rect.w = rect.h = 120;
-    for( int j = 0; j < 9; ++j )
+    // copy the damaged parts of all regions, one batch per texture (e.g., all
+    // buttons share the atlas); regions never overlap, so the order is free
+    copies_.clear();
+    for( const SDL_Rect &rect : damage_ )
     {
-      rect.y = j*120;
-      for( int i = 0; i < 16; ++i )
+      for( const Region &region : regions_ )
       {
-        rect.x = i*120;
-        if( tile( i, j ).texture )
-          SDL_RenderCopy( renderer_, tile( i, j ).texture, &tile( i, j ).rect, &rect );
+        SDL_Rect dst;
+        if( !intersect( region.dst, rect, dst ) )
+          continue;
+        const SDL_Rect src{ region.src.x + dst.x - region.dst.x, region.src.y + dst.y - region.dst.y, dst.w, dst.h };
+        copies_.push_back( Region{ region.texture, src, dst } );
       }
+      frame_.damagedArea += rect.w * rect.h;
+    }
+    damage_.clear();
+    std::stable_sort( copies_.begin(), copies_.end(), [] ( const Region &a, const Region &b ) { return std::less< SDL_Texture * >()( a.texture, b.texture ); } );
+    for( auto pos = copies_.cbegin(); pos != copies_.cend(); )
+    {
+      const auto end = std::find_if( pos, copies_.cend(), [ pos ] ( const Region &r ) { return (r.texture != pos->texture); } );
+      submit( pos, end );
+      pos = end;
     }
 
-    SDL_RenderPresent( renderer_ );
+    setRenderTarget( nullptr );
+    const SDL_Rect grid{ x0_, y0_, width(), height() };
+    SDL_SetRenderDrawColor( renderer_, 0, 0, 0, 255 );
+    SDL_RenderClear( renderer_ );
+    SDL_RenderCopy( renderer_, composite_, nullptr, &grid );
+    ++frame_.copies;
+    if( hud )
+      drawHud();
+    if( !headless_ )
+    {
+      const Uint64 start = (hud ? SDL_GetPerformanceCounter() : 0);
+      SDL_RenderPresent( renderer_ );
+      if( hud )
+        frame_.presentTime = milliseconds( SDL_GetPerformanceCounter() - start );
+    }
+
+    // the time since the last present, except for waiting for input
+    const Uint64 now = SDL_GetPerformanceCounter();
+    if( hud )
+      hudFrames_.add( milliseconds( now - lastPresent_ - std::min( frameWaitTicks_, now - lastPresent_ ) ) );
+    lastPresent_ = now;
+    frameWaitTicks_ = 0;
+
+    if( firstInput_ != 0 )
+    {
+      loop_.latency.add( SDL_GetTicks() - firstInput_ );
+      firstInput_ = 0;
+    }
+
+    lastFrame_ = frame_;
+    frame_ = FrameStatistics();
   }
 
-  void eventLoop ()
+  // report a damaged rectangle in screen coordinates
+  void damage ( SDL_Rect rect ) const
   {
-    draw();
-    std::vector< std::unique_ptr< Lambda > > lambdaTrashBin;
-    while( true )
+    if( !intersect( rect, SDL_Rect{ 0, 0, width(), height() }, rect ) )
+      return;
+
+    // merge with all touching rectangles
+    for( auto pos = damage_.begin(); pos != damage_.end(); )
     {
-      SDL_Event event;
-      bool redraw = false;
-      while( SDL_PollEvent( &event ) )
+      if( touches( *pos, rect ) )
       {
-        if( event.type == lambdaEvent )
-        {
-          Lambda *lambda = static_cast< Lambda * >( event.user.data1 );
-          redraw |= (*lambda)();
-          lambdaTrashBin.emplace_back( lambda );
-        }
+        unite( rect, *pos );
+        damage_.erase( pos );
+        pos = damage_.begin();
+      }
+      else
+        ++pos;
+    }
+    damage_.push_back( rect );
 
-        switch( event.type )
-        {
-        case SDL_QUIT:
-          return;
+    // too many rectangles cost more in copies than they save in area
+    if( damage_.size() > 16 )
+    {
+      for( const SDL_Rect &r : damage_ )
+        unite( rect, r );
+      damage_.assign( 1, rect );
+    }
+  }
 
-        case SDL_MOUSEBUTTONDOWN:
-          if( event.button.button == SDL_BUTTON_LEFT )
-          {
-            const int i = event.button.x / 120;
-            const int j = event.button.y / 120;
-            Touchable *touchable = tile( i, j ).touchable;
-            if( touchable )
-              redraw |= touchable->down( tile( i, j ).rect.x + event.button.x - i*120, tile( i, j ).rect.y + event.button.y - j*120 );
-          }
-          break;
+  // report a damaged rectangle in the coordinates of a texture
+  void damage ( SDL_Texture *texture, const SDL_Rect &rect ) const
+  {
+    for( const Region &region : regions_ )
+    {
+      SDL_Rect src;
+      if( (region.texture == texture) && intersect( region.src, rect, src ) )
+        damage( SDL_Rect{ region.dst.x + src.x - region.src.x, region.dst.y + src.y - region.src.y, src.w, src.h } );
+    }
+  }
 
-        case SDL_MOUSEBUTTONUP:
-          if( event.button.button == SDL_BUTTON_LEFT )
-          {
-            const int i = event.button.x / 120;
-            const int j = event.button.y / 120;
-            Touchable *touchable = tile( i, j ).touchable;
-            if( touchable )
-              redraw |= touchable->up( tile( i, j ).rect.x + event.button.x - i*120, tile( i, j ).rect.y + event.button.y - j*120 );
-          }
-          break;
+  const FrameStatistics &statistics () const { return lastFrame_; }
+  FrameStatistics &frameStatistics () const { return frame_; }
+  const LoopStatistics &loopStatistics () const { return loop_; }
 
-        case SDL_MOUSEMOTION:
-          if( event.motion.state & SDL_BUTTON( SDL_BUTTON_LEFT ) )
-          {
-            const int i = event.motion.x / 120;
-            const int j = event.motion.y / 120;
-            Touchable *touchable = tile( i, j ).touchable;
-            if( touchable )
-              redraw |= touchable->move( tile( i, j ).rect.x + event.motion.x - i*120, tile( i, j ).rect.y + event.motion.y - j*120, event.motion.xrel, event.motion.yrel );
-          }
-          break;
+  void eventLoop ()
+  {
+    draw();
 
-        case SDL_FINGERDOWN:
-          {
-            const int x = event.tfinger.x * width();
-            const int y = event.tfinger.y * height();
-
-            const int i = x / 120;
-            const int j = y / 120;
-            Touchable *touchable = tile( i, j ).touchable;
-            if( touchable )
-              redraw |= touchable->down( tile( i, j ).rect.x + x - i*120, tile( i, j ).rect.y + y - j*120 );
-          }
-          break;
+    std::vector< SDL_Event > events( 64 );
+    bool redraw = false;
+    while( true )
+    {
+      // sleep until the next event arrives or, if a redraw is pending, the next
+      // frame is due (input to be presented in low-latency mode is due at once);
+      // pending tasks are due as soon as there is budget left
+      const bool pending = redraw || !damage_.empty() || !scheduler_.empty();
+      const Uint64 now = SDL_GetPerformanceCounter();
+      Sint64 remaining = Sint64( lastPresent_ + frameTicks_ ) - Sint64( now );
+      if( !scheduler_.empty() )
+      {
+        const Sint64 budget = (budgetLeft() ? 0 : Sint64( taskPeriod_ + frameTicks_ ) - Sint64( now ));
+        remaining = (redraw || !damage_.empty() ? std::min( remaining, budget ) : budget);
+      }
+      int count = 0;
+      if( replay_ )
+      {
+        // a replay never waits; it ends when the trace is replayed and drawn
+        if( !replayFrame( redraw ) && !pending )
+          return;
+      }
+      else if( !pending || ((remaining > 0) && !urgent()) )
+      {
+        const Uint64 start = SDL_GetPerformanceCounter();
+        if( !pending )
+          count = SDL_WaitEvent( &events[ 0 ] );
+        else
+          count = SDL_WaitEventTimeout( &events[ 0 ], int( (remaining * 1000 + SDL_GetPerformanceFrequency() - 1) / SDL_GetPerformanceFrequency() ) );
+        const Uint64 waited = SDL_GetPerformanceCounter() - start;
+        waitTicks_ += waited;
+        frameWaitTicks_ += waited;
+        ++wakeups_;
+      }
 
-        case SDL_FINGERUP:
-          {
-            const int x = event.tfinger.x * width();
-            const int y = event.tfinger.y * height();
-
-            const int i = x / 120;
-            const int j = y / 120;
-            Touchable *touchable = tile( i, j ).touchable;
-            if( touchable )
-              redraw |= touchable->up( tile( i, j ).rect.x + x - i*120, tile( i, j ).rect.y + y - j*120 );
-          }
+      // drain the queue in bulk, merging consecutive motion events; touches of
+      // a touch reader go first
+      SDL_PumpEvents();
+      while( true )
+      {
+        if( touchReader_ )
+          dispatchTouches( redraw );
+        count += std::max( SDL_PeepEvents( events.data() + count, events.size() - count, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT ), 0 );
+        if( count == 0 )
           break;
-
-        case SDL_FINGERMOTION:
+        if( trace_ )
+          record( events.data(), count );
+        count = coalesce( events.data(), count );
+        for( int k = 0; k < count; ++k )
+        {
+          // after quitting, no task will ever run; cancel them
+          if( !dispatch( events[ k ], redraw ) )
           {
-            const int x = event.tfinger.x * width();
-            const int y = event.tfinger.y * height();
-            const int dx = event.tfinger.dx * width();
-            const int dy = event.tfinger.dy * height();
-
-            const int i = x / 120;
-            const int j = y / 120;
-            Touchable *touchable = tile( i, j ).touchable;
-            if( touchable )
-              redraw |= touchable->move( tile( i, j ).rect.x + x - i*120, tile( i, j ).rect.y + y - j*120, dx, dy );
+            tasks_.close();
+            scheduler_.clear();
+            return;
           }
+        }
+        count = 0;
+        if( urgent() )
           break;
+      }
 
-        case SDL_KEYDOWN:
-          if( event.key.keysym.sym == SDLK_ESCAPE )
-            return;
-          break;
+      // execute everything recorded during this frame with one target switch per texture
+      flush();
 
-        case SDL_WINDOWEVENT:
-          redraw |= true;
-          break;
-        }
+      // present at most once per frame interval, unless in low-latency mode
+      // (or replaying a trace)
+      if( (redraw || !damage_.empty()) && (urgent() || replay_ || (SDL_GetPerformanceCounter() >= lastPresent_ + frameTicks_)) )
+      {
+        const Uint64 last = lastPresent_;
+        draw();
+        redraw = false;
+        if( replay_ )
+          replayStatistics_.frames.push_back( 1000.0 * double( lastPresent_ - last ) / double( SDL_GetPerformanceFrequency() ) );
       }
 
-      if( redraw )
-        draw();
-      else
-        SDL_Delay( 1 );
-      lambdaTrashBin.clear();
+      // tasks only run once the input is handled and presented; whatever they
+      // draw is presented in the next frame
+      runTasks( redraw );
+      updateLoopStatistics();
     }
   }
 
@@ -256,25 +1081,97 @@ public:
   {
     tile( i, j ).texture = texture;
     tile( i, j ).touchable = touchable;
-    tile( i, j ).rect.x = x;
-    tile( i, j ).rect.y = y;
+    tile( i, j ).rect = SDL_Rect{ x, y, tileSize_, tileSize_ };
+    updateRegions();
+    damage( SDL_Rect{ i*tileSize_, j*tileSize_, tileSize_, tileSize_ } );
+  }
+
+  // read touches from the given reader, which is started here, instead of
+  // SDL's event queue (the reader must outlive the event loop)
+  void setTouchReader ( TouchReader &reader )
+  {
+    touchReader_ = &reader;
+    touchEvent_ = SDL_RegisterEvents( 1 );
+    const Uint32 type = touchEvent_;
+    reader.start( [ type ] () {
+        SDL_Event event;
+        SDL_memset( &event, 0, sizeof( event ) );
+        event.type = type;
+        SDL_PushEvent( &event );
+      } );
+  }
+
+  // record all input into a trace (or stop recording, if trace is null)
+  void setTrace ( Trace *trace ) { trace_ = trace; }
+
+  // run the event loop on the input of a trace instead of waiting for input;
+  // the events of each frame interval of the trace are dispatched at once and
+  // each frame changed is drawn right away, so the trace is replayed as fast
+  // as possible. Returns at the end of the trace.
+  TraceStatistics replay ( TraceReader &reader )
+  {
+    replay_ = &reader;
+    replayStatistics_ = TraceStatistics();
+    const Uint64 start = SDL_GetPerformanceCounter();
+    eventLoop();
+    replayStatistics_.replayed = double( SDL_GetPerformanceCounter() - start ) / double( SDL_GetPerformanceFrequency() );
+    replayStatistics_.recorded = reader.time();
+    replay_ = nullptr;
+    return std::move( replayStatistics_ );
+  }
+
+  void registerFlushable ( Flushable *flushable )
+  {
+    flushables_.push_back( flushable );
+  }
+
+  // flush a Flushable with the next frame (or earlier, if its content is needed)
+  void defer ( Flushable *flushable ) const
+  {
+    if( std::find( pending_.begin(), pending_.end(), flushable ) == pending_.end() )
+      pending_.push_back( flushable );
+  }
+
+  void cancel ( Flushable *flushable ) const
+  {
+    pending_.erase( std::remove( pending_.begin(), pending_.end(), flushable ), pending_.end() );
+  }
+
+  void flushPending () const
+  {
+    std::vector< Flushable * > pending;
+    std::swap( pending, pending_ );
+    for( Flushable *flushable : pending )
+      flushable->flush();
+  }
+
+  // only switch render targets if necessary and count the switches
+  void setRenderTarget ( SDL_Texture *texture ) const
+  {
+    if( texture == renderTarget_ )
+      return;
+    SDL_SetRenderTarget( renderer_, texture );
+    renderTarget_ = texture;
+    ++frame_.targetSwitches;
   }
 
+  // run f, returning whether to redraw, in the event loop after the input;
+  // may be called from any thread. Tasks of higher priority run first, a task
+  // with the key (non-zero) and type of a pending one is merged into it (see
+  // Task::coalesce). Returns false if the task queue is full (or closed,
+  // because the event loop has quit), in which case f is destroyed without
+  // running.
   template< class F, std::enable_if_t< std::is_same< decltype( std::declval< F & >()() ), bool >::value, int > = 0 >
-  void pushLambdaEvent ( F f )
+  bool pushTask ( F f, std::size_t key = 0, Task::Priority priority = Task::normal )
   {
-    SDL_Event event;
-    SDL_memset( &event, 0, sizeof( event ) );
-    event.type = lambdaEvent;
-    event.user.data1 = new LambdaWrapper< F >( std::move( f ) );
-    SDL_PushEvent( &event );
+    return tasks_.push( Task( std::move( f ), key, priority ) );
   }
 
   void registerTiles ( int i, int j, int w, int h, SDL_Texture *texture, Touchable *touchable, int x = 0, int y = 0 )
   {
     for( int jj = 0; jj < h; ++jj )
       for( int ii = 0; ii < w; ++ii )
-        registerTile( i+ii, j+jj, texture, touchable, x+120*ii, y+120*jj );
+        registerTile( i+ii, j+jj, texture, touchable, x+tileSize_*ii, y+tileSize_*jj );
   }
 };
 
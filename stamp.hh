@@ -0,0 +1,91 @@
+#ifndef STAMP_HH
+#define STAMP_HH
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "png.hh"
+
+
+// Falloff
+// -------
+//
+// Coverage of a round brush at a given distance from its centre. It falls off
+// from radius*hardness to radius, leaving at least one pixel for
+// anti-aliasing; a smoothstep avoids a visible edge for soft brushes.
+
+struct Falloff
+{
+  Falloff ( float radius, float hardness )
+    : radius( radius ), scale( 1.0f / (radius - std::max( std::min( radius*hardness, radius - 1.0f ), 0.0f )) )
+  {}
+
+  std::uint8_t operator() ( float distance ) const
+  {
+    const float t = std::min( std::max( (radius - distance) * scale, 0.0f ), 1.0f );
+    return std::uint8_t( 255.0f * t*t*(3.0f - 2.0f*t) + 0.5f );
+  }
+
+  float radius, scale;
+};
+
+
+
+// Stamp
+// -----
+//
+// 8-bit coverage mask of a pen, either taken from the alpha channel of a PNG
+// image or generated for a round brush from its distance field. The stamp is
+// centred at (width()/2, height()/2).
+
+class Stamp
+{
+  int width_, height_;
+  std::unique_ptr< std::uint8_t[] > coverage_;
+
+public:
+  Stamp ( const void *data, std::size_t size )
+  {
+    std::istringstream in( std::string( static_cast< const char * >( data ), size ) );
+    png::input png_in( in );
+
+    auto info = png_in.read_info();
+    width_ = info.image_width();
+    height_ = info.image_height();
+
+    const int channels = info.channels();
+    const std::size_t pitch = channels*width_;
+    auto image = png_in.read_image( pitch, height_ );
+
+    coverage_.reset( new std::uint8_t[ width_*height_ ] );
+    for( int k = 0; k < width_*height_; ++k )
+      coverage_[ k ] = ((channels == 2) || (channels == 4) ? image[ channels*k + channels-1 ] : 255);
+  }
+
+  // round brush (see Falloff)
+  Stamp ( float radius, float hardness )
+    : width_( 2*int( std::ceil( radius ) ) + 1 ), height_( width_ ),
+      coverage_( new std::uint8_t[ width_*height_ ] )
+  {
+    const Falloff falloff( radius, hardness );
+    const float c = 0.5f*(width_ - 1);
+    for( int y = 0; y < height_; ++y )
+      for( int x = 0; x < width_; ++x )
+        coverage_[ y*width_ + x ] = falloff( std::hypot( x - c, y - c ) );
+  }
+
+  int width () const { return width_; }
+  int height () const { return height_; }
+  int pitch () const { return width_; }
+
+  const std::uint8_t *coverage () const { return coverage_.get(); }
+  const std::uint8_t *coverage ( int x, int y ) const { return coverage_.get() + y*width_ + x; }
+};
+
+#endif // #ifndef STAMP_HH
@@ -0,0 +1,58 @@
+#ifndef STATS_HH
+#define STATS_HH
+
+#include <cstddef>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+
+// p-th percentile (0 <= p <= 100) of some values
+inline double percentile ( std::vector< double > values, double p )
+{
+  if( values.empty() )
+    return 0.0;
+  const std::size_t k = std::min( std::size_t( p / 100.0 * values.size() ), values.size() - 1 );
+  std::nth_element( values.begin(), values.begin() + k, values.end() );
+  return values[ k ];
+}
+
+
+// Samples
+// -------
+//
+// Ring buffer holding the most recent samples of a measurement, e.g., frame
+// times, from which percentiles are computed on demand.
+
+template< std::size_t n = 1024 >
+class Samples
+{
+public:
+  void add ( double value )
+  {
+    values_[ next_ ] = value;
+    next_ = (next_ + 1) % n;
+    size_ = std::min( size_ + 1, n );
+  }
+
+  std::size_t size () const { return size_; }
+  bool empty () const { return (size_ == 0); }
+
+  // the most recent sample (k = 0) or the ones before (k > 0)
+  double recent ( std::size_t k = 0 ) const { return values_[ (next_ + n - 1 - k) % n ]; }
+
+  // p-th percentile (0 <= p <= 100) of the samples
+  double percentile ( double p ) const
+  {
+    return ::percentile( std::vector< double >( values_.begin(), values_.begin() + size_ ), p );
+  }
+
+  void clear () { next_ = size_ = 0; }
+
+private:
+  std::array< double, n > values_;
+  std::size_t next_ = 0, size_ = 0;
+};
+
+#endif // #ifndef STATS_HH
@@ -0,0 +1,204 @@
+#ifndef STROKE_HH
+#define STROKE_HH
+
+#include <cmath>
+
+#include <algorithm>
+#include <array>
+
+
+// Stroke
+// ------
+//
+// Turns a sequence of input points (in sub-pixel precision) into stamp
+// positions, spaced at a fixed fraction of the pen radius. If smoothing is
+// enabled, the input points are interpolated by a Catmull-Rom spline; this
+// delays the stamps by one input point. The number of stamps per segment is
+// bounded, so long jumps (e.g., after a stall) do not cost arbitrarily much.
+//
+// A continuous stroke emits the vertices of its (smoothed) polyline instead of
+// spaced stamps, e.g., for drawing it as a sequence of capsules. Vertices
+// closer than a fraction of the pen radius are merged, so consecutive
+// capsules overlap only little.
+
+class Stroke
+{
+public:
+  struct Point
+  {
+    float x, y;
+  };
+
+  struct Parameters
+  {
+    float spacing = 0.25f;      // stamp distance relative to the pen radius
+    bool smooth = true;         // interpolate input points by a Catmull-Rom spline
+    int maxStamps = 256;        // maximum number of stamps per input segment
+    bool continuous = false;    // emit polyline vertices instead of stamps
+    float length = 0.5f;        // minimum distance of polyline vertices relative to the pen radius
+  };
+
+  explicit Stroke ( float radius = 1.0f )
+    : Stroke( radius, Parameters() )
+  {}
+
+  Stroke ( float radius, Parameters parameters )
+    : parameters_( parameters )
+  {
+    setRadius( radius );
+  }
+
+  const Parameters &parameters () const { return parameters_; }
+
+  void setParameters ( const Parameters &parameters )
+  {
+    parameters_ = parameters;
+    setRadius( radius_ );
+  }
+
+  void setRadius ( float radius )
+  {
+    radius_ = radius;
+    spacing_ = std::max( parameters_.spacing * radius_, 0.5f );
+  }
+
+  bool active () const { return (count_ > 0); }
+
+  // the point emitted last; while stamping, the one before the current point
+  Point last () const { return last_; }
+
+  // the input point given last and the number of input points so far
+  Point current () const { return points_[ 3 ]; }
+  int count () const { return count_; }
+
+  // the input point before the current one (if count() > 1)
+  Point previous () const { return points_[ 2 ]; }
+
+  template< class F >
+  void begin ( Point p, F &&stamp )
+  {
+    points_[ 0 ] = points_[ 1 ] = points_[ 2 ] = points_[ 3 ] = p;
+    count_ = 1;
+    distance_ = 0.0f;
+    last_ = p;
+    emit( p, stamp );
+  }
+
+  template< class F >
+  void extend ( Point p, F &&stamp )
+  {
+    if( !active() )
+      return begin( p, stamp );
+
+    const Point &last = points_[ 3 ];
+    if( (p.x == last.x) && (p.y == last.y) )
+      return;
+
+    std::rotate( points_.begin(), points_.begin()+1, points_.end() );
+    points_[ 3 ] = p;
+    ++count_;
+
+    if( !parameters_.smooth )
+      walk( points_[ 2 ], points_[ 3 ], stamp );
+    else if( count_ > 2 )
+      segment( points_[ 0 ], points_[ 1 ], points_[ 2 ], points_[ 3 ], stamp );
+  }
+
+  template< class F >
+  void end ( Point p, F &&stamp )
+  {
+    if( !active() )
+      return;
+
+    extend( p, stamp );
+    // the last segment of a smoothed stroke is still pending
+    if( parameters_.smooth && (count_ > 1) )
+      segment( points_[ 1 ], points_[ 2 ], points_[ 3 ], points_[ 3 ], stamp );
+    // flush the merged tail of a continuous stroke
+    if( parameters_.continuous && (distance_ > 0.0f) )
+      emit( points_[ 3 ], stamp );
+    count_ = 0;
+  }
+
+private:
+  template< class F >
+  void emit ( Point p, F &&stamp )
+  {
+    stamp( p.x, p.y );
+    last_ = p;
+  }
+
+  // stamp spacing for a segment of given length, bounding the number of stamps
+  float spacing ( float length ) const
+  {
+    return std::max( spacing_, length / parameters_.maxStamps );
+  }
+
+  // walk along the straight line from a to b, stamping every spacing pixels
+  template< class F >
+  void walk ( Point a, Point b, float spacing, F &&stamp )
+  {
+    const float dx = b.x - a.x, dy = b.y - a.y;
+    const float length = std::sqrt( dx*dx + dy*dy );
+    if( length <= 0.0f )
+      return;
+
+    if( parameters_.continuous )
+    {
+      distance_ += length;
+      if( distance_ >= parameters_.length * radius_ )
+      {
+        emit( b, stamp );
+        distance_ = 0.0f;
+      }
+      return;
+    }
+
+    float t = std::max( spacing - distance_, 0.0f );
+    for( ; t <= length; t += spacing )
+      emit( Point{ a.x + dx * (t / length), a.y + dy * (t / length) }, stamp );
+    distance_ = length - (t - spacing);
+  }
+
+  template< class F >
+  void walk ( Point a, Point b, F &&stamp )
+  {
+    walk( a, b, spacing( std::hypot( b.x - a.x, b.y - a.y ) ), stamp );
+  }
+
+  // walk along the Catmull-Rom segment from p1 to p2
+  template< class F >
+  void segment ( Point p0, Point p1, Point p2, Point p3, F &&stamp )
+  {
+    const float chord = std::hypot( p2.x - p1.x, p2.y - p1.y );
+    const int n = std::min( std::max( int( std::ceil( chord / 4.0f ) ), 1 ), 16 );
+
+    std::array< Point, 17 > polyline;
+    float length = 0.0f;
+    polyline[ 0 ] = p1;
+    for( int k = 1; k <= n; ++k )
+    {
+      const float t = float( k ) / float( n ), t2 = t*t, t3 = t2*t;
+      const float c0 = -0.5f*t3 + t2 - 0.5f*t;
+      const float c1 = 1.5f*t3 - 2.5f*t2 + 1.0f;
+      const float c2 = -1.5f*t3 + 2.0f*t2 + 0.5f*t;
+      const float c3 = 0.5f*t3 - 0.5f*t2;
+      polyline[ k ] = Point{ c0*p0.x + c1*p1.x + c2*p2.x + c3*p3.x, c0*p0.y + c1*p1.y + c2*p2.y + c3*p3.y };
+      length += std::hypot( polyline[ k ].x - polyline[ k-1 ].x, polyline[ k ].y - polyline[ k-1 ].y );
+    }
+
+    const float spacing = this->spacing( length );
+    for( int k = 1; k <= n; ++k )
+      walk( polyline[ k-1 ], polyline[ k ], spacing, stamp );
+  }
+
+  Parameters parameters_;
+  float radius_ = 1.0f, spacing_ = 1.0f;
+
+  std::array< Point, 4 > points_;
+  Point last_ = Point{ 0.0f, 0.0f };
+  int count_ = 0;
+  float distance_ = 0.0f;
+};
+
+#endif // #ifndef STROKE_HH
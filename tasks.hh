@@ -0,0 +1,524 @@
+#ifndef TASKS_HH
+#define TASKS_HH
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "stats.hh"
+
+
+// TaskResult
+// ----------
+//
+// Receives the result of a task run on another thread. It lives with the
+// receiver (e.g., in a request handler), the task gets a TaskPromise pointing
+// to it, so neither side allocates. A promise destroyed without a value, e.g.,
+// because its task was dropped, cancels the result. The result must not be
+// destroyed before it is set or cancelled; the destructor waits for that.
+//
+// Promises can be merged, so one value is delivered to several results (see
+// SharedTask); the results are chained through the results themselves.
+
+template< class T >
+class TaskResult;
+
+template< class T >
+class TaskPromise
+{
+  TaskResult< T > *result_;
+
+public:
+  explicit TaskPromise ( TaskResult< T > &result ) : result_( &result ) {}
+
+  TaskPromise ( TaskPromise &&other ) : result_( other.result_ ) { other.result_ = nullptr; }
+  TaskPromise ( const TaskPromise & ) = delete;
+
+  TaskPromise &operator= ( TaskPromise && ) = delete;
+  TaskPromise &operator= ( const TaskPromise & ) = delete;
+
+  ~TaskPromise ()
+  {
+    // a result may be gone as soon as it is resolved
+    for( TaskResult< T > *result = result_; result; )
+      std::exchange( result, result->next_ )->resolve( nullptr );
+  }
+
+  void set ( T value )
+  {
+    for( TaskResult< T > *result = std::exchange( result_, nullptr ); result; )
+    {
+      TaskResult< T > *next = result->next_;
+      if( next )
+      {
+        T copy( value );
+        result->resolve( &copy );
+      }
+      else
+        result->resolve( &value );
+      result = next;
+    }
+  }
+
+  // deliver the value to the results of another promise as well
+  void merge ( TaskPromise &&other )
+  {
+    TaskResult< T > **tail = &result_;
+    while( *tail )
+      tail = &(*tail)->next_;
+    *tail = std::exchange( other.result_, nullptr );
+  }
+};
+
+template< class T >
+class TaskResult
+{
+  friend class TaskPromise< T >;
+
+  enum State { pending, done, cancelled };
+
+public:
+  TaskResult () = default;
+  TaskResult ( const TaskResult & ) = delete;
+  TaskResult &operator= ( const TaskResult & ) = delete;
+
+  ~TaskResult ()
+  {
+    if( promised_ )
+    {
+      std::unique_lock< std::mutex > lock( mutex_ );
+      resolved_.wait( lock, [ this ] () { return (state_ != pending); } );
+    }
+  }
+
+  // the promise for the task; there is only one
+  TaskPromise< T > promise ()
+  {
+    promised_ = true;
+    return TaskPromise< T >( *this );
+  }
+
+  // wait for the result; returns false if the task was cancelled
+  bool wait ( T &value )
+  {
+    std::unique_lock< std::mutex > lock( mutex_ );
+    resolved_.wait( lock, [ this ] () { return (state_ != pending); } );
+    if( state_ != done )
+      return false;
+    value = std::move( value_ );
+    return true;
+  }
+
+private:
+  void resolve ( T *value )
+  {
+    std::lock_guard< std::mutex > lock( mutex_ );
+    if( value )
+      value_ = std::move( *value );
+    state_ = (value ? done : cancelled);
+    resolved_.notify_all();
+  }
+
+  std::mutex mutex_;
+  std::condition_variable resolved_;
+  State state_ = pending;
+  bool promised_ = false;
+  T value_;
+  TaskResult *next_ = nullptr;
+};
+
+
+
+// Task
+// ----
+//
+// A callable returning whether the screen needs to be redrawn, stored in a
+// small buffer of its own, so tasks can be queued and moved without any
+// allocation; the callable must fit into the buffer (checked at compile time).
+// Tasks with the same (non-zero) key and type are duplicates: coalescing
+// merges one into the other by calling the callable's merge method or, if it
+// has none, by dropping the later one.
+
+class Task
+{
+public:
+  enum Priority : std::uint8_t { high = 0, normal = 1, low = 2 };
+
+  static constexpr std::size_t storage = 64;
+
+  Task () = default;
+
+  template< class F, std::enable_if_t< !std::is_same< std::decay_t< F >, Task >::value, int > = 0 >
+  explicit Task ( F &&f, std::size_t key = 0, Priority priority = normal )
+    : ops_( ops< std::decay_t< F > >() ), key_( key ), priority_( priority ),
+      posted_( std::chrono::steady_clock::now() )
+  {
+    using Callable = std::decay_t< F >;
+    static_assert( sizeof( Callable ) <= storage, "Task does not fit into its buffer" );
+    static_assert( alignof( Callable ) <= alignof( std::max_align_t ), "Task is overaligned" );
+    new (buffer_) Callable( std::forward< F >( f ) );
+  }
+
+  Task ( Task &&other ) { *this = std::move( other ); }
+  Task ( const Task & ) = delete;
+
+  Task &operator= ( Task &&other )
+  {
+    if( this == &other )
+      return *this;
+    reset();
+    if( other.ops_ )
+      other.ops_->move( buffer_, other.buffer_ );
+    ops_ = std::exchange( other.ops_, nullptr );
+    key_ = other.key_;
+    priority_ = other.priority_;
+    posted_ = other.posted_;
+    return *this;
+  }
+
+  Task &operator= ( const Task & ) = delete;
+
+  ~Task () { reset(); }
+
+  explicit operator bool () const { return (ops_ != nullptr); }
+
+  bool operator() () { return ops_->run( buffer_ ); }
+
+  std::size_t key () const { return key_; }
+  Priority priority () const { return priority_; }
+  std::chrono::steady_clock::time_point posted () const { return posted_; }
+
+  // merge a duplicate into this task, leaving other empty; returns false if
+  // other is no duplicate
+  bool coalesce ( Task &other )
+  {
+    if( (key_ == 0) || (other.key_ != key_) || (other.ops_ != ops_) || !ops_ )
+      return false;
+    ops_->merge( buffer_, other.buffer_ );
+    other.reset();
+    priority_ = std::min( priority_, other.priority_ );
+    return true;
+  }
+
+  void reset ()
+  {
+    if( ops_ )
+      ops_->destroy( buffer_ );
+    ops_ = nullptr;
+  }
+
+private:
+  struct Ops
+  {
+    bool (*run) ( void *f );
+    void (*move) ( void *to, void *from );    // move constructs to, destroys from
+    void (*destroy) ( void *f );
+    void (*merge) ( void *into, void *from );
+  };
+
+  template< class F >
+  static auto merge ( F &into, F &from, int ) -> decltype( into.merge( std::move( from ) ), void() ) { into.merge( std::move( from ) ); }
+
+  template< class F >
+  static void merge ( F &into, F &from, long ) {}
+
+  template< class F >
+  static const Ops *ops ()
+  {
+    static const Ops ops = {
+        [] ( void *f ) -> bool { return (*static_cast< F * >( f ))(); },
+        [] ( void *to, void *from ) { new (to) F( std::move( *static_cast< F * >( from ) ) ); static_cast< F * >( from )->~F(); },
+        [] ( void *f ) { static_cast< F * >( f )->~F(); },
+        [] ( void *into, void *from ) { merge( *static_cast< F * >( into ), *static_cast< F * >( from ), 0 ); }
+      };
+    return &ops;
+  }
+
+  const Ops *ops_ = nullptr;
+  std::size_t key_ = 0;
+  Priority priority_ = normal;
+  std::chrono::steady_clock::time_point posted_;
+  alignas( std::max_align_t ) unsigned char buffer_[ storage ];
+};
+
+
+
+// SharedTask
+// ----------
+//
+// Task computing a value for a TaskPromise. Duplicates merge their promises,
+// so the value is computed once for all of them, e.g., a single encoding of
+// the canvas for several requests of it.
+
+template< class T, class F >
+class SharedTask
+{
+  F compute_;
+  TaskPromise< T > promise_;
+
+public:
+  SharedTask ( F compute, TaskPromise< T > promise )
+    : compute_( std::move( compute ) ), promise_( std::move( promise ) )
+  {}
+
+  bool operator() ()
+  {
+    promise_.set( compute_() );
+    return false;
+  }
+
+  void merge ( SharedTask &&other ) { promise_.merge( std::move( other.promise_ ) ); }
+};
+
+template< class T, class F >
+inline SharedTask< T, F > makeSharedTask ( TaskPromise< T > promise, F compute )
+{
+  return SharedTask< T, F >( std::move( compute ), std::move( promise ) );
+}
+
+
+
+// TaskQueue
+// ---------
+//
+// Bounded lock-free queue of tasks, posted by any number of threads (e.g., the
+// web server's) and taken by a single one (the event loop). The tasks are
+// moved into the cells of a fixed ring, so posting never allocates; the cells
+// are claimed by a sequence number per cell (Vyukov's bounded queue). Like the
+// TouchReader, the consumer is notified only when the queue was drained
+// before, so a burst of tasks costs one wake-up.
+
+template< std::size_t n = 64 >
+class TaskQueue
+{
+  static_assert( (n & (n-1)) == 0, "Size of task queue must be a power of two" );
+
+  struct alignas( 64 ) Cell
+  {
+    std::atomic< std::size_t > sequence;
+    Task task;
+  };
+
+public:
+  TaskQueue ()
+  {
+    for( std::size_t k = 0; k < n; ++k )
+      cells_[ k ].sequence.store( k, std::memory_order_relaxed );
+  }
+
+  TaskQueue ( const TaskQueue & ) = delete;
+  TaskQueue &operator= ( const TaskQueue & ) = delete;
+
+  ~TaskQueue () { close(); }
+
+  // set the function called (from the posting thread) when tasks become
+  // available after run() has emptied the queue
+  void setNotify ( std::function< void () > notify ) { notify_ = std::move( notify ); }
+
+  // post a task; returns false if the queue is full or closed, in which case
+  // the task is destroyed without running
+  bool push ( Task task )
+  {
+    // close() waits for producers having passed the check
+    Producer producer( producers_ );
+    if( closed_.load() )
+      return reject();
+
+    std::size_t pos = tail_.load( std::memory_order_relaxed );
+    Cell *cell;
+    while( true )
+    {
+      cell = &cells_[ pos & (n-1) ];
+      const std::intptr_t diff = std::intptr_t( cell->sequence.load( std::memory_order_acquire ) ) - std::intptr_t( pos );
+      if( diff == 0 )
+      {
+        if( tail_.compare_exchange_weak( pos, pos+1, std::memory_order_relaxed ) )
+          break;
+      }
+      else if( diff < 0 )
+        return reject();
+      else
+        pos = tail_.load( std::memory_order_relaxed );
+    }
+
+    // remember the deepest the queue has been; measured before publishing the
+    // task, as the consumer may take it (and more) right after
+    const std::size_t head = head_.load( std::memory_order_relaxed );
+    const std::size_t size = std::min( (pos >= head ? pos+1 - head : 0), n );
+    cell->task = std::move( task );
+    cell->sequence.store( pos+1, std::memory_order_release );
+
+    std::size_t peak = peak_.load( std::memory_order_relaxed );
+    while( (size > peak) && !peak_.compare_exchange_weak( peak, size, std::memory_order_relaxed ) )
+      continue;
+
+    // pairs with the exchange in drain(): either the consumer sees the task or
+    // this sees the flag cleared and notifies
+    if( !notified_.exchange( true, std::memory_order_seq_cst ) && notify_ )
+      notify_();
+    return true;
+  }
+
+  // hand all tasks queued to f (taking a Task &&); call from the consumer
+  // thread only
+  template< class F >
+  void drain ( F &&f )
+  {
+    // clear the flag before looking at the queue, so a task pushed meanwhile
+    // is either drained or notified; a plain store might be reordered after
+    // the loads of the queue, while the exchange reads the flag of the last
+    // push and synchronizes with it (see push)
+    notified_.exchange( false, std::memory_order_seq_cst );
+    while( next() )
+    {
+      Cell &cell = cells_[ head_.load( std::memory_order_relaxed ) & (n-1) ];
+      Task task( std::move( cell.task ) );
+      release( cell );
+      f( std::move( task ) );
+    }
+  }
+
+  // reject all further tasks and destroy the ones queued without running them
+  // (cancelling their results); call from the consumer thread only
+  void close ()
+  {
+    closed_.store( true );
+    while( producers_.load() > 0 )
+      std::this_thread::yield();
+    drain( [] ( Task && ) {} );
+  }
+
+  // number of tasks queued
+  std::size_t size () const { return tail_.load( std::memory_order_relaxed ) - head_.load( std::memory_order_relaxed ); }
+
+  // most tasks queued at once since the last reset
+  std::size_t peak () const { return peak_.load( std::memory_order_relaxed ); }
+  void resetPeak () { peak_.store( size(), std::memory_order_relaxed ); }
+
+  // number of tasks rejected, because the queue was full or closed
+  std::size_t rejected () const { return rejected_.load( std::memory_order_relaxed ); }
+
+  static constexpr std::size_t capacity () { return n; }
+
+private:
+  struct Producer
+  {
+    explicit Producer ( std::atomic< int > &count ) : count_( count ) { ++count_; }
+    ~Producer () { --count_; }
+
+    std::atomic< int > &count_;
+  };
+
+  bool reject ()
+  {
+    rejected_.fetch_add( 1, std::memory_order_relaxed );
+    return false;
+  }
+
+  // is the cell at the head published?
+  bool next () const
+  {
+    const std::size_t head = head_.load( std::memory_order_relaxed );
+    return (cells_[ head & (n-1) ].sequence.load( std::memory_order_acquire ) == head+1);
+  }
+
+  // hand the (empty) cell at the head back to the producers
+  void release ( Cell &cell )
+  {
+    const std::size_t head = head_.load( std::memory_order_relaxed );
+    cell.sequence.store( head+n, std::memory_order_release );
+    head_.store( head+1, std::memory_order_relaxed );
+  }
+
+  std::array< Cell, n > cells_;
+  alignas( 64 ) std::atomic< std::size_t > tail_{ 0 };
+  alignas( 64 ) std::atomic< std::size_t > head_{ 0 };
+  std::atomic< std::size_t > peak_{ 0 };
+  std::atomic< std::size_t > rejected_{ 0 };
+  std::atomic< int > producers_{ 0 };
+  std::atomic< bool > closed_{ false };
+  std::atomic< bool > notified_{ false };
+  std::function< void () > notify_;
+};
+
+
+
+// TaskScheduler
+// -------------
+//
+// Runs the tasks taken from a TaskQueue on the main thread within a time
+// budget, so they do not hold up input (see Screen::taskBudget): tasks of
+// higher priority first, otherwise in the order posted. A task started is
+// always finished, so a long task may overrun the budget. Duplicates of a
+// pending task are merged into it (see Task::coalesce), but not across a task
+// without key posted in between, which might change their result.
+
+class TaskScheduler
+{
+public:
+  TaskScheduler () { pending_.reserve( 64 ); }
+
+  bool empty () const { return pending_.empty(); }
+  std::size_t size () const { return pending_.size(); }
+
+  void add ( Task task )
+  {
+    for( auto pos = pending_.rbegin(); pos != pending_.rend(); ++pos )
+    {
+      if( pos->coalesce( task ) )
+      {
+        ++coalesced_;
+        return;
+      }
+      if( pos->key() == 0 )
+        break;
+    }
+    pending_.push_back( std::move( task ) );
+  }
+
+  // run tasks as long as the budget (in ms) is not used up, but at least one;
+  // returns the number of tasks run, redraw is set if any of them asks for it
+  unsigned int run ( double budget, bool &redraw )
+  {
+    const auto start = std::chrono::steady_clock::now();
+    unsigned int count = 0;
+    for( auto now = start; !pending_.empty() && ((count == 0) || (std::chrono::duration< double, std::milli >( now - start ).count() < budget)); now = std::chrono::steady_clock::now(), ++count )
+    {
+      // the first of the highest priority
+      const auto pos = std::min_element( pending_.begin(), pending_.end(), [] ( const Task &a, const Task &b ) { return (a.priority() < b.priority()); } );
+      Task task( std::move( *pos ) );
+      pending_.erase( pos );
+      latency_.add( std::chrono::duration< double, std::milli >( now - task.posted() ).count() );
+      redraw |= task();
+    }
+    return count;
+  }
+
+  // destroy all pending tasks without running them (cancelling their results)
+  void clear () { pending_.clear(); }
+
+  // time from posting a task to running it (in ms)
+  const Samples<> &latency () const { return latency_; }
+
+  // number of tasks merged into a pending duplicate
+  std::size_t coalesced () const { return coalesced_; }
+
+private:
+  std::vector< Task > pending_;
+  Samples<> latency_;
+  std::size_t coalesced_ = 0;
+};
+
+#endif // #ifndef TASKS_HH
@@ -3,24 +3,109 @@
 
 #include <cstdint>
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <vector>
 
 #include <SDL.h>
 
+#include "palette.hh"
 #include "png.hh"
 #include "screen.hh"
 
 // Texture
 // -------
+//
+// Blits and clears into a texture are recorded and executed when the texture
+// is flushed, i.e., with the next frame. Hence, all drawing into a texture
+// during one frame costs one switch of the render target.
 
 class Texture
+  : public Flushable
 {
+  struct Command
+  {
+    SDL_Texture *src;   // nullptr for clear
+    SDL_Rect rect;
+    SDL_Color color;
+  };
+
 protected:
+  const Screen *screen_ = nullptr;
   SDL_Renderer *renderer_ = nullptr;
   SDL_Texture *texture_ = nullptr;
   int width_, height_;
 
+private:
+  std::vector< Command > commands_;
+
+  // box filter of RGBA pixels, weighting colours by their alpha
+  static void resample ( const std::uint8_t *src, int srcWidth, int srcHeight, std::uint8_t *dst, int width, int height )
+  {
+    for( int y = 0; y < height; ++y )
+    {
+      const int y0 = y*srcHeight / height, y1 = std::max( (y+1)*srcHeight / height, y0+1 );
+      for( int x = 0; x < width; ++x, dst += 4 )
+      {
+        const int x0 = x*srcWidth / width, x1 = std::max( (x+1)*srcWidth / width, x0+1 );
+        std::uint32_t sum[ 4 ] = { 0, 0, 0, 0 };
+        for( int j = y0; j < y1; ++j )
+        {
+          for( const std::uint8_t *p = src + 4*(j*srcWidth + x0); p != src + 4*(j*srcWidth + x1); p += 4 )
+          {
+            for( int c = 0; c < 3; ++c )
+              sum[ c ] += p[ c ] * p[ 3 ];
+            sum[ 3 ] += p[ 3 ];
+          }
+        }
+        const std::uint32_t count = (x1 - x0) * (y1 - y0);
+        for( int c = 0; c < 3; ++c )
+          dst[ c ] = std::uint8_t( sum[ 3 ] > 0 ? (sum[ c ] + sum[ 3 ]/2) / sum[ 3 ] : 0 );
+        dst[ 3 ] = std::uint8_t( (sum[ 3 ] + count/2) / count );
+      }
+    }
+  }
+
+  void record ( const Command &command )
+  {
+    if( commands_.empty() )
+      screen_->defer( this );
+    commands_.push_back( command );
+  }
+
+  // submit a run of blits from the same source texture
+  void submit ( std::vector< Command >::const_iterator begin, std::vector< Command >::const_iterator end )
+  {
+    SDL_Texture *src = begin->src;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    SDL_Color color;
+    SDL_GetTextureColorMod( src, &color.r, &color.g, &color.b );
+    SDL_GetTextureAlphaMod( src, &color.a );
+
+    std::vector< SDL_Vertex > vertices;
+    std::vector< int > indices;
+    vertices.reserve( 4*(end - begin) );
+    indices.reserve( 6*(end - begin) );
+    for( ; begin != end; ++begin )
+    {
+      const int k = vertices.size();
+      const float x0 = begin->rect.x, y0 = begin->rect.y;
+      const float x1 = x0 + begin->rect.w, y1 = y0 + begin->rect.h;
+      vertices.push_back( SDL_Vertex{ SDL_FPoint{ x0, y0 }, color, SDL_FPoint{ 0.0f, 0.0f } } );
+      vertices.push_back( SDL_Vertex{ SDL_FPoint{ x1, y0 }, color, SDL_FPoint{ 1.0f, 0.0f } } );
+      vertices.push_back( SDL_Vertex{ SDL_FPoint{ x1, y1 }, color, SDL_FPoint{ 1.0f, 1.0f } } );
+      vertices.push_back( SDL_Vertex{ SDL_FPoint{ x0, y1 }, color, SDL_FPoint{ 0.0f, 1.0f } } );
+      for( int i : { 0, 1, 2, 0, 2, 3 } )
+        indices.push_back( k + i );
+    }
+    SDL_RenderGeometry( renderer_, src, vertices.data(), vertices.size(), indices.data(), indices.size() );
+#else // #if SDL_VERSION_ATLEAST(2, 0, 18)
+    for( ; begin != end; ++begin )
+      SDL_RenderCopy( renderer_, src, nullptr, &begin->rect );
+#endif // #else // #if SDL_VERSION_ATLEAST(2, 0, 18)
+  }
+
 public:
   enum class Access
     : int
@@ -31,7 +116,7 @@ public:
   };
 
   Texture ( const Screen &screen, const std::string &file )
-    : renderer_( screen.renderer_ )
+    : screen_( &screen ), renderer_( screen.renderer_ )
   {
     std::ifstream in( file );
     png::input png_in( in );
@@ -51,7 +136,7 @@ public:
   }
 
   Texture ( const Screen &screen, const void *data, std::size_t size )
-    : renderer_( screen.renderer_ )
+    : screen_( &screen ), renderer_( screen.renderer_ )
   {
     std::istringstream in( std::string( static_cast< const char * >( data ), size ) );
     png::input png_in( in );
@@ -71,13 +156,13 @@ public:
   }
 
   Texture ( const Screen &screen, int width, int height, Access access = Access::Streaming )
-    : renderer_( screen.renderer_ ),
+    : screen_( &screen ), renderer_( screen.renderer_ ),
       texture_( SDL_CreateTexture( renderer_, SDL_PIXELFORMAT_ABGR8888, static_cast< int >( access ), width, height ) ),
       width_( width ), height_( height )
   {}
 
   Texture ( const Screen &screen, int width, int height, Uint8 r, Uint8 g, Uint8 b )
-    : renderer_( screen.renderer_ ),
+    : screen_( &screen ), renderer_( screen.renderer_ ),
       width_( width ), height_( height )
   {
     SDL_Surface *surface = SDL_CreateRGBSurface( 0, width, height, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 );
@@ -89,41 +174,94 @@ public:
   Texture ( const Texture & ) = delete;
   Texture ( Texture && ) = delete;
 
-  ~Texture () { SDL_DestroyTexture( texture_ ); }
+  ~Texture ()
+  {
+    // pending blits might still refer to this texture as their source
+    screen_->cancel( this );
+    screen_->flushPending();
+    if( screen_->renderTarget_ == texture_ )
+      screen_->setRenderTarget( nullptr );
+    SDL_DestroyTexture( texture_ );
+  }
 
   Texture &operator= ( const Texture & ) = delete;
   Texture &operator= ( Texture && ) = delete;
 
   void blit ( int x, int y, const Texture &src )
   {
-    SDL_Rect rect;
-    rect.w = src.width();
-    rect.h = src.height();
-    rect.x = x;
-    rect.y = y;
-
-    SDL_SetRenderTarget( renderer_, texture_ );
-    SDL_RenderCopy( renderer_, src.texture_, nullptr, &rect );
-    SDL_SetRenderTarget( renderer_, nullptr );
+    record( Command{ src.texture_, SDL_Rect{ x, y, src.width(), src.height() }, SDL_Color{ 0, 0, 0, 0 } } );
   }
 
   void clear ( Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255 )
   {
-    SDL_SetRenderTarget( renderer_, texture_ );
-    SDL_SetRenderDrawColor( renderer_, r, g, b, a );
-    SDL_RenderClear( renderer_ );
-    SDL_SetRenderTarget( renderer_, nullptr );
+    // a clear makes all previous commands obsolete
+    commands_.clear();
+    record( Command{ nullptr, SDL_Rect{ 0, 0, width_, height_ }, SDL_Color{ r, g, b, a } } );
+  }
+
+  // Flushable
+
+  void flush () override
+  {
+    if( commands_.empty() )
+      return;
+
+    screen_->setRenderTarget( texture_ );
+    for( auto pos = commands_.cbegin(); pos != commands_.cend(); )
+    {
+      if( !pos->src )
+      {
+        SDL_SetRenderDrawColor( renderer_, pos->color.r, pos->color.g, pos->color.b, pos->color.a );
+        SDL_RenderClear( renderer_ );
+        screen_->damage( texture_, pos->rect );
+        ++pos;
+        continue;
+      }
+
+      auto end = pos;
+      while( (end != commands_.cend()) && (end->src == pos->src) )
+        ++end;
+      screen_->frameStatistics().blits += end - pos;
+      for( auto it = pos; it != end; ++it )
+        screen_->damage( texture_, it->rect );
+      submit( pos, end );
+      pos = end;
+    }
+    commands_.clear();
   }
 
   int width () const { return width_; }
   int height () const { return height_; }
 
+  SDL_Texture *texture () const { return texture_; }
+
+  // RGBA pixels of a PNG image, resampled to width x height; icons are
+  // rasterized at a high resolution and shrunk to the tile size of the screen
+  static std::vector< std::uint8_t > decode ( const void *data, std::size_t size, int width, int height )
+  {
+    std::istringstream in( std::string( static_cast< const char * >( data ), size ) );
+    png::input png_in( in );
+
+    auto info = png_in.read_info();
+    const int srcWidth = info.image_width(), srcHeight = info.image_height();
+    const int channels = info.channels();
+    auto image = png_in.read_image( channels*srcWidth, srcHeight );
+
+    std::vector< std::uint8_t > rgba( 4*srcWidth*srcHeight, 255 );
+    for( int k = 0; k < srcWidth*srcHeight; ++k )
+      std::copy( image.get() + channels*k, image.get() + channels*(k+1), rgba.data() + 4*k );
+
+    std::vector< std::uint8_t > pixels( 4*width*height );
+    resample( rgba.data(), srcWidth, srcHeight, pixels.data(), width, height );
+    return pixels;
+  }
+
   std::unique_ptr< std::uint8_t[] > pixels () const
   {
+    screen_->flushPending();
     std::unique_ptr< std::uint8_t[] > pixels( new std::uint8_t[ 4*width_*height_ ] );
-    SDL_SetRenderTarget( renderer_, texture_ );
+    screen_->setRenderTarget( texture_ );
     SDL_RenderReadPixels( renderer_, nullptr, SDL_PIXELFORMAT_ABGR8888, pixels.get(), 4*width_ );
-    SDL_SetRenderTarget( renderer_, nullptr );
     return pixels;
   }
 
@@ -137,15 +275,34 @@ public:
     {
       const std::size_t pitch = info.channels()*width_;
       auto image = png_in.read_image( pitch, height_ );
+      commands_.clear();
+      screen_->cancel( this );
       SDL_UpdateTexture( texture_, nullptr, image.get(), pitch );
     }
   }
 
+  // textures with at most 256 colours are saved with a palette, which
+  // quarters the data to be compressed
   void save ( std::ostream &out )
   {
+    std::unique_ptr< std::uint8_t[] > pixels = this->pixels();
     png::output png_out( out );
-    png_out.write_info( width_, height_, 8, png::color_type_t::rgb_alpha );
-    png_out.write_image( pixels(), 4*width_, height_ );
+
+    Palette palette;
+    if( palette.add( pixels.get(), width_*height_ ) )
+    {
+      std::unique_ptr< std::uint8_t[] > indices( new std::uint8_t[ width_*height_ ] );
+      palette.index( pixels.get(), width_*height_, indices.get() );
+      png::info_t info = png_out.create_info( width_, height_, 8, png::color_type_t::palette );
+      png_out.set_palette( info, palette.data(), palette.size() );
+      png_out.write_info( std::move( info ) );
+      png_out.write_image( std::move( indices ), width_, height_ );
+    }
+    else
+    {
+      png_out.write_info( width_, height_, 8, png::color_type_t::rgb_alpha );
+      png_out.write_image( std::move( pixels ), 4*width_, height_ );
+    }
     png_out.write_end();
   }
 
@@ -157,10 +314,10 @@ public:
 
   void saveBMP ( const std::string &fileName )
   {
+    screen_->flushPending();
     SDL_Surface *surface = SDL_CreateRGBSurface( 0, width_, height_, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 );
-    SDL_SetRenderTarget( renderer_, texture_ );
+    screen_->setRenderTarget( texture_ );
     SDL_RenderReadPixels( renderer_, nullptr, SDL_PIXELFORMAT_ABGR8888, surface->pixels, surface->pitch );
-    SDL_SetRenderTarget( renderer_, nullptr );
     SDL_SaveBMP( surface, fileName.c_str() );
     SDL_FreeSurface( surface );
   }
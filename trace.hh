@@ -0,0 +1,236 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+#include <cstdint>
+#include <cstring>
+
+#include <fstream>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <SDL.h>
+
+#include "varint.hh"
+
+
+// Trace
+// -----
+//
+// Binary log of the raw input events of a session, before any coalescing, to
+// replay them through the event loop (see Screen::replay and bench-trace). The
+// header holds the size of the output in pixels. Each record consists of the
+// SDL event type, the time since the previous record (in milliseconds, taken
+// from SDL's timestamps) and the fields of the event. Mouse coordinates are
+// stored in pixels and touches normalized, so a trace replays on any screen of
+// the same output size, e.g., a headless one.
+
+class Trace
+{
+public:
+  static const char *magic () { return "KDT1"; }
+  static constexpr std::size_t magicSize = 4;
+
+  Trace ( const std::string &file, int width, int height )
+    : out_( file, std::ios::binary | std::ios::trunc )
+  {
+    if( !out_ )
+      throw std::runtime_error( "Unable to create trace '" + file + "'" );
+    out_.write( magic(), magicSize );
+    writeVarint( out_, width );
+    writeVarint( out_, height );
+    out_.flush();
+  }
+
+  // record a mouse or touch event (anything else is ignored); mouse
+  // coordinates must be given in pixels
+  void record ( const SDL_Event &event )
+  {
+    switch( event.type )
+    {
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+      header( event );
+      writeVarint( out_, event.button.which );
+      out_.put( char( event.button.button ) );
+      writeSigned( out_, event.button.x );
+      writeSigned( out_, event.button.y );
+      break;
+
+    case SDL_MOUSEMOTION:
+      header( event );
+      writeVarint( out_, event.motion.which );
+      writeVarint( out_, event.motion.state );
+      writeSigned( out_, event.motion.x );
+      writeSigned( out_, event.motion.y );
+      writeSigned( out_, event.motion.xrel );
+      writeSigned( out_, event.motion.yrel );
+      break;
+
+    case SDL_FINGERDOWN:
+    case SDL_FINGERUP:
+    case SDL_FINGERMOTION:
+      header( event );
+      writeSigned( out_, event.tfinger.touchId );
+      writeSigned( out_, event.tfinger.fingerId );
+      writeFloat( out_, event.tfinger.x );
+      writeFloat( out_, event.tfinger.y );
+      writeFloat( out_, event.tfinger.dx );
+      writeFloat( out_, event.tfinger.dy );
+      writeFloat( out_, event.tfinger.pressure );
+      break;
+
+    default:
+      return;
+    }
+
+    // like the journal, the trace is flushed whenever a stroke ends
+    if( (event.type == SDL_MOUSEBUTTONUP) || (event.type == SDL_FINGERUP) )
+      out_.flush();
+  }
+
+private:
+  void header ( const SDL_Event &event )
+  {
+    if( first_ )
+      last_ = event.common.timestamp;
+    first_ = false;
+    writeVarint( out_, event.type );
+    // signed, as touches of a touch reader are stamped when read (and may
+    // precede SDL's events queued before)
+    writeSigned( out_, std::int32_t( event.common.timestamp - last_ ) );
+    last_ = event.common.timestamp;
+  }
+
+  std::ofstream out_;
+  bool first_ = true;
+  Uint32 last_ = 0;
+};
+
+
+
+// TraceReader
+// -----------
+
+class TraceReader
+{
+public:
+  explicit TraceReader ( std::istream &in )
+    : in_( in )
+  {
+    char magic[ Trace::magicSize ];
+    std::uint64_t width, height;
+    if( !in_.read( magic, Trace::magicSize ) || (std::memcmp( magic, Trace::magic(), Trace::magicSize ) != 0)
+        || !readVarint( in_, width ) || !readVarint( in_, height ) )
+      throw std::runtime_error( "Invalid trace" );
+    width_ = int( width );
+    height_ = int( height );
+  }
+
+  // size of the output the trace was recorded on (in pixels)
+  int width () const { return width_; }
+  int height () const { return height_; }
+
+  // time of the last event read (in milliseconds since the first one)
+  std::int64_t time () const { return time_; }
+
+  // read the next event, its timestamp being time(); returns false at the end
+  // or at a truncated record
+  bool next ( SDL_Event &event )
+  {
+    std::uint64_t type;
+    std::int64_t time;
+    if( !readVarint( in_, type ) || !readSigned( in_, time ) )
+      return false;
+
+    SDL_memset( &event, 0, sizeof( event ) );
+    event.type = Uint32( type );
+    event.common.timestamp = Uint32( time_ + time );
+    std::uint64_t which, state;
+    std::int64_t x, y, xrel, yrel, touchId, fingerId;
+    switch( event.type )
+    {
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+    {
+      if( !readVarint( in_, which ) )
+        return false;
+      const int button = in_.get();
+      if( !readSigned( in_, x ) || !readSigned( in_, y ) )
+        return false;
+      event.button.which = Uint32( which );
+      event.button.button = Uint8( button );
+      event.button.state = (event.type == SDL_MOUSEBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED);
+      event.button.x = Sint32( x );
+      event.button.y = Sint32( y );
+      break;
+    }
+
+    case SDL_MOUSEMOTION:
+      if( !readVarint( in_, which ) || !readVarint( in_, state ) || !readSigned( in_, x ) || !readSigned( in_, y ) || !readSigned( in_, xrel ) || !readSigned( in_, yrel ) )
+        return false;
+      event.motion.which = Uint32( which );
+      event.motion.state = Uint32( state );
+      event.motion.x = Sint32( x );
+      event.motion.y = Sint32( y );
+      event.motion.xrel = Sint32( xrel );
+      event.motion.yrel = Sint32( yrel );
+      break;
+
+    case SDL_FINGERDOWN:
+    case SDL_FINGERUP:
+    case SDL_FINGERMOTION:
+      if( !readSigned( in_, touchId ) || !readSigned( in_, fingerId )
+          || !readFloat( in_, event.tfinger.x ) || !readFloat( in_, event.tfinger.y )
+          || !readFloat( in_, event.tfinger.dx ) || !readFloat( in_, event.tfinger.dy ) || !readFloat( in_, event.tfinger.pressure ) )
+        return false;
+      event.tfinger.touchId = touchId;
+      event.tfinger.fingerId = fingerId;
+      break;
+
+    default:
+      throw std::runtime_error( "Invalid trace record (type " + std::to_string( type ) + ")" );
+    }
+
+    time_ += time;
+    return true;
+  }
+
+  // read the events of the next frame, i.e., the next event and all following
+  // ones less than interval milliseconds after it; returns false at the end
+  bool frame ( Uint32 interval, std::vector< SDL_Event > &events )
+  {
+    events.clear();
+    if( !pending_ && !(pending_ = next( next_ )) )
+      return false;
+
+    const Uint32 start = next_.common.timestamp;
+    do
+      events.push_back( next_ );
+    while( (pending_ = next( next_ )) && (Sint32( next_.common.timestamp - start ) < Sint32( interval )) );
+    return true;
+  }
+
+private:
+  std::istream &in_;
+  int width_ = 0, height_ = 0;
+  std::int64_t time_ = 0;
+  SDL_Event next_;
+  bool pending_ = false;
+};
+
+
+
+// TraceStatistics
+// ---------------
+
+struct TraceStatistics
+{
+  unsigned long events = 0;     // input events replayed
+  std::int64_t recorded = 0;    // recorded time in milliseconds
+  double replayed = 0.0;        // time taken to replay in seconds
+  std::vector< double > frames; // time of each frame (in ms), from present to present
+};
+
+#endif // #ifndef TRACE_HH
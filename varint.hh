@@ -0,0 +1,69 @@
+#ifndef VARINT_HH
+#define VARINT_HH
+
+#include <cstdint>
+#include <cstring>
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+
+// Varints
+// -------
+//
+// Encoding of the binary logs (see Journal and Trace): unsigned integers as
+// little-endian base-128 varints, signed ones zigzag encoded first, so small
+// magnitudes take a single byte, and floats as their exact bytes. The readers
+// return false at the end of the stream or at a truncated value.
+
+inline void writeVarint ( std::ostream &out, std::uint64_t value )
+{
+  for( ; value >= 0x80; value >>= 7 )
+    out.put( char( (value & 0x7f) | 0x80 ) );
+  out.put( char( value ) );
+}
+
+inline void writeSigned ( std::ostream &out, std::int64_t value ) { writeVarint( out, (std::uint64_t( value ) << 1) ^ std::uint64_t( value >> 63 ) ); }
+
+inline void writeFloat ( std::ostream &out, float value )
+{
+  char bytes[ sizeof( value ) ];
+  std::memcpy( bytes, &value, sizeof( value ) );
+  out.write( bytes, sizeof( bytes ) );
+}
+
+inline bool readVarint ( std::istream &in, std::uint64_t &value )
+{
+  value = 0;
+  for( int shift = 0; shift < 64; shift += 7 )
+  {
+    const int c = in.get();
+    if( c == std::char_traits< char >::eof() )
+      return false;
+    value |= std::uint64_t( c & 0x7f ) << shift;
+    if( !(c & 0x80) )
+      return true;
+  }
+  return false;
+}
+
+inline bool readSigned ( std::istream &in, std::int64_t &value )
+{
+  std::uint64_t v;
+  if( !readVarint( in, v ) )
+    return false;
+  value = std::int64_t( v >> 1 ) ^ -std::int64_t( v & 1 );
+  return true;
+}
+
+inline bool readFloat ( std::istream &in, float &value )
+{
+  char bytes[ sizeof( value ) ];
+  if( !in.read( bytes, sizeof( bytes ) ) )
+    return false;
+  std::memcpy( &value, bytes, sizeof( value ) );
+  return true;
+}
+
+#endif // #ifndef VARINT_HH